@@ -32,4 +32,19 @@ attribute. The terminal capabilities should be checked through ::t3_term_get_cap
 
 @include example.c
 
+@section Threads
+
+libt3window is designed to be used from a single thread, with one exception:
+windows may be painted from other threads. A thread that paints into a window
+must hold the lock of that window, which is taken with ::t3_win_lock and
+released with ::t3_win_unlock. ::t3_term_update takes the locks of all windows
+while compositing the terminal contents, such that a window is never shown
+partially painted. The mapping of attributes used while painting is safe for
+concurrent use. All other functions, including those that create, move,
+resize, show, hide or delete windows, must be called from the main thread.
+
+A thread should not hold more than one window lock at a time, and the main
+thread must not call ::t3_term_update while holding a window lock. If the
+library was compiled without thread support, the locking functions do nothing.
+
 */
@@ -0,0 +1,414 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAS_PTHREAD
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#endif
+
+#include "async_output.h"
+#include "frame_buffer.h"
+#include "internal.h"
+#include "trace.h"
+
+/* The curses header file defines too many symbols that get in the way of our
+   own, so we have a separate C file which exports only those functions that
+   we actually use. */
+#include "curses_interface.h"
+
+/* In asynchronous output mode, ::t3_term_update only composites the terminal lines and copies them
+   into a frame, which is handed to a writer thread. The writer thread compares the frame to the
+   lines it emitted last, and sends the differences to the terminal. This way the calling thread
+   never waits for the terminal.
+
+   Frames are passed through a single slot (pending_frame), which is only accessed using atomic
+   exchange operations. If the calling thread publishes a new frame before the writer thread has
+   picked up the previous one, the previous frame is simply dropped: the new frame contains all
+   lines, so nothing is lost by not emitting the intermediate state. Frames that are no longer
+   needed are put in a second slot (spare_frame), such that the memory for the lines can be reused
+   by the next frame.
+
+   While the writer thread is running, it owns all state related to the terminal output: the frame
+   buffer, the current attributes and the cursor state. The output conversion state is also used
+   by ::t3_term_can_draw on the calling thread, so it is protected by a mutex. The writer thread
+   only holds the mutex while building a frame, never while writing it to the terminal. */
+
+/** @internal Boolean indicating whether asynchronous output was requested. */
+t3_bool _t3_async_output;
+
+#ifdef HAS_PTHREAD
+typedef struct {
+  line_data_t *lines;  /* Contents of the terminal lines. */
+  int lines_allocated; /* Number of elements allocated in lines. */
+  int height, width;   /* Size of the terminal. */
+  t3_bool show_cursor; /* Cursor state after emitting the frame. */
+  int cursor_y, cursor_x;
+  t3_bool sync_output; /* Whether to use synchronized output. */
+  int flags;           /* Requests to handle before emitting the frame (ASYNC_*). */
+} async_frame_t;
+
+static pthread_t writer;
+static sem_t frames_available;
+static pthread_mutex_t output_state_lock;
+static pthread_once_t output_state_lock_once = PTHREAD_ONCE_INIT;
+static t3_bool writer_active; /**< Boolean indicating whether the writer thread is running. */
+static t3_bool stop_writer;   /**< Boolean indicating the writer thread should stop. */
+static int requested_flags;   /**< Requests to pass to the writer thread with the next frame. */
+
+static async_frame_t *pending_frame, /**< Frame waiting to be emitted by the writer thread. */
+    *spare_frame;                    /**< Frame available for reuse. */
+
+/* Lines as last emitted by the writer thread. Only accessed by the writer thread while it runs. */
+static line_data_t *emitted_lines;
+static int emitted_lines_allocated, emitted_height, emitted_width;
+
+/** Ensure that @p lines has at least @p count elements, each with allocated data. */
+static t3_bool ensure_lines(line_data_t **lines, int *allocated, int count) {
+  line_data_t *new_lines;
+
+  if (*allocated >= count) {
+    return t3_true;
+  }
+  if ((new_lines = realloc(*lines, count * sizeof(line_data_t))) == NULL) {
+    return t3_false;
+  }
+  *lines = new_lines;
+  for (; *allocated < count; (*allocated)++) {
+    line_data_t *line = &new_lines[*allocated];
+    if ((line->data = malloc(INITIAL_ALLOC)) == NULL) {
+      return t3_false;
+    }
+    line->allocated = INITIAL_ALLOC;
+    line->start = 0;
+    line->width = 0;
+    line->length = 0;
+  }
+  return t3_true;
+}
+
+/** Free an array of lines allocated with ensure_lines. */
+static void free_lines(line_data_t *lines, int allocated) {
+  int i;
+  for (i = 0; i < allocated; i++) {
+    free(lines[i].data);
+  }
+  free(lines);
+}
+
+/** Copy the contents of line @p src to line @p dst. */
+static t3_bool copy_line(line_data_t *dst, const line_data_t *src) {
+  if (dst->allocated < src->length) {
+    char *new_data = realloc(dst->data, src->length);
+    if (new_data == NULL) {
+      return t3_false;
+    }
+    dst->data = new_data;
+    dst->allocated = src->length;
+  }
+  memcpy(dst->data, src->data, src->length);
+  dst->start = src->start;
+  dst->width = src->width;
+  dst->length = src->length;
+  return t3_true;
+}
+
+static void free_frame(async_frame_t *frame) {
+  if (frame == NULL) {
+    return;
+  }
+  free_lines(frame->lines, frame->lines_allocated);
+  free(frame);
+}
+
+/** Make @p frame available for reuse, freeing the frame it replaces. */
+static void recycle_frame(async_frame_t *frame) {
+  free_frame(__atomic_exchange_n(&spare_frame, frame, __ATOMIC_ACQ_REL));
+}
+
+/** Send the differences between @p frame and the emitted lines to the terminal. */
+static void emit_frame(async_frame_t *frame) {
+  t3_bool redraw = (frame->flags & ASYNC_REDRAW) || frame->height != emitted_height ||
+                   frame->width != emitted_width;
+  int i;
+  size_t length;
+  t3_bool result;
+
+  TRACE(TRACE_ASYNC_FRAME_BEGIN, frame->flags, 0, 0);
+  if (!ensure_lines(&emitted_lines, &emitted_lines_allocated, frame->height)) {
+    return;
+  }
+
+  _t3_lock_output_state();
+  if (frame->flags & ASYNC_DETECT_SIZE) {
+    _t3_send_size_detection_query();
+    _t3_cursor_y = -1;
+  }
+  /* Clearing the terminal moves the cursor, so make sure it is repositioned afterwards. */
+  if (redraw) {
+    _t3_cursor_y = -1;
+  }
+
+  _t3_begin_frame(frame->sync_output, frame->show_cursor, frame->cursor_y, frame->cursor_x);
+  if (redraw) {
+    _t3_set_attrs(0);
+    _t3_putp(_t3_clear);
+    for (i = 0; i < frame->height; i++) {
+      emitted_lines[i].start = 0;
+      emitted_lines[i].width = 0;
+      emitted_lines[i].length = 0;
+    }
+    emitted_height = frame->height;
+    emitted_width = frame->width;
+  }
+
+  for (i = 0; i < frame->height; i++) {
+    line_data_t tmp;
+    /* The windows may have changed since the frame was composited, so the output can not be
+       attributed to the windows. */
+    _t3_emit_line(i, &frame->lines[i], &emitted_lines[i], frame->width, t3_false);
+    /* The frame is recycled after this, so simply take over the buffer of the new line. */
+    tmp = emitted_lines[i];
+    emitted_lines[i] = frame->lines[i];
+    frame->lines[i] = tmp;
+  }
+  _t3_end_frame(frame->sync_output, frame->show_cursor, frame->cursor_y, frame->cursor_x,
+                frame->height, frame->width);
+  _t3_unlock_output_state();
+
+  length = _t3_frame_length();
+  result = _t3_frame_flush();
+  TRACE(TRACE_ASYNC_FRAME_END, frame->height, length, result);
+}
+
+/** Main loop of the writer thread. */
+static void *writer_thread(void *arg) {
+  async_frame_t *frame;
+  t3_bool stop;
+
+  (void)arg;
+  while (1) {
+    while (sem_wait(&frames_available) != 0 && errno == EINTR) {
+    }
+    /* Check for the stop request first, such that the last frame published before it is emitted. */
+    stop = __atomic_load_n(&stop_writer, __ATOMIC_ACQUIRE);
+    if ((frame = __atomic_exchange_n(&pending_frame, NULL, __ATOMIC_ACQ_REL)) != NULL) {
+      emit_frame(frame);
+      recycle_frame(frame);
+    }
+    if (stop) {
+      return NULL;
+    }
+  }
+}
+
+/** @internal
+    @brief Start the writer thread for asynchronous output.
+    @return A boolean indicating whether the writer thread was started.
+
+    The writer thread takes over the current contents of the terminal window as the lines already
+    emitted, and all pending output is written before starting it.
+*/
+t3_bool _t3_start_async_output(void) {
+  sigset_t all_signals, saved_signals;
+  int i, result;
+
+  if (writer_active) {
+    return t3_true;
+  }
+
+  _t3_frame_flush();
+  if (!ensure_lines(&emitted_lines, &emitted_lines_allocated, _t3_terminal_window->height)) {
+    return t3_false;
+  }
+  for (i = 0; i < _t3_terminal_window->height; i++) {
+    if (!copy_line(&emitted_lines[i], &_t3_terminal_window->lines[i])) {
+      return t3_false;
+    }
+  }
+  emitted_height = _t3_terminal_window->height;
+  emitted_width = _t3_terminal_window->width;
+  requested_flags = 0;
+  stop_writer = t3_false;
+
+  if (sem_init(&frames_available, 0, 0) != 0) {
+    return t3_false;
+  }
+  /* Signals such as SIGWINCH should be handled by the program's own threads. */
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &saved_signals);
+  result = pthread_create(&writer, NULL, writer_thread, NULL);
+  pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+  if (result != 0) {
+    sem_destroy(&frames_available);
+    return t3_false;
+  }
+  writer_active = t3_true;
+  return t3_true;
+}
+
+/** @internal
+    @brief Stop the writer thread for asynchronous output.
+
+    The writer thread emits the last published frame before it stops. Afterwards, the terminal
+    window contains the lines as emitted, such that the synchronous update code can continue from
+    there.
+*/
+void _t3_stop_async_output(void) {
+  int i;
+
+  if (!writer_active) {
+    return;
+  }
+
+  __atomic_store_n(&stop_writer, t3_true, __ATOMIC_RELEASE);
+  sem_post(&frames_available);
+  pthread_join(writer, NULL);
+  sem_destroy(&frames_available);
+  writer_active = t3_false;
+
+  for (i = 0; i < _t3_terminal_window->height; i++) {
+    line_data_t *line = &_t3_terminal_window->lines[i];
+    if (emitted_height == _t3_terminal_window->height &&
+        emitted_width == _t3_terminal_window->width) {
+      line_data_t tmp = *line;
+      *line = emitted_lines[i];
+      emitted_lines[i] = tmp;
+    } else {
+      line->start = 0;
+      line->width = _t3_terminal_window->width;
+      line->length = 0;
+    }
+  }
+  free_lines(emitted_lines, emitted_lines_allocated);
+  emitted_lines = NULL;
+  emitted_lines_allocated = 0;
+  free_frame(__atomic_exchange_n(&pending_frame, NULL, __ATOMIC_ACQ_REL));
+  free_frame(__atomic_exchange_n(&spare_frame, NULL, __ATOMIC_ACQ_REL));
+
+  /* Handle the requests that were not passed to the writer thread. */
+  if (requested_flags & ASYNC_DETECT_SIZE) {
+    _t3_send_size_detection_query();
+  }
+  if (requested_flags & ASYNC_REDRAW) {
+    t3_term_redraw();
+  }
+  requested_flags = 0;
+}
+
+/** @internal
+    @brief Check whether the writer thread for asynchronous output is running. */
+t3_bool _t3_async_output_active(void) { return writer_active; }
+
+/** @internal
+    @brief Request an action from the writer thread, which is performed before emitting the next
+        frame.
+    @param flags The ASYNC_* flags for the requested actions.
+*/
+void _t3_async_request(int flags) { requested_flags |= flags; }
+
+/** @internal
+    @brief Pass the current contents of the terminal window to the writer thread.
+    @param show_cursor Boolean indicating whether the cursor should be visible after the frame.
+    @param cursor_y The line at which the cursor should be positioned after the frame.
+    @param cursor_x The column at which the cursor should be positioned after the frame.
+    @param sync_output Boolean indicating whether to use synchronized output.
+    @return A boolean indicating whether the frame was published.
+
+    If the writer thread has not started emitting the previously published frame yet, that frame
+    is dropped.
+*/
+t3_bool _t3_async_publish(t3_bool show_cursor, int cursor_y, int cursor_x, t3_bool sync_output) {
+  async_frame_t *frame, *dropped;
+  int i;
+
+  if ((frame = __atomic_exchange_n(&spare_frame, NULL, __ATOMIC_ACQ_REL)) == NULL &&
+      (frame = calloc(1, sizeof(async_frame_t))) == NULL) {
+    return t3_false;
+  }
+
+  if (!ensure_lines(&frame->lines, &frame->lines_allocated, _t3_terminal_window->height)) {
+    recycle_frame(frame);
+    return t3_false;
+  }
+  for (i = 0; i < _t3_terminal_window->height; i++) {
+    if (!copy_line(&frame->lines[i], &_t3_terminal_window->lines[i])) {
+      recycle_frame(frame);
+      return t3_false;
+    }
+  }
+  frame->height = _t3_terminal_window->height;
+  frame->width = _t3_terminal_window->width;
+  frame->show_cursor = show_cursor;
+  frame->cursor_y = cursor_y;
+  frame->cursor_x = cursor_x;
+  frame->sync_output = sync_output;
+  frame->flags = requested_flags;
+  requested_flags = 0;
+
+  /* Take back the frame that was not picked up yet, such that its requests are not lost. Only this
+     thread stores frames in the pending slot, so it is guaranteed to be empty afterwards. */
+  if ((dropped = __atomic_exchange_n(&pending_frame, NULL, __ATOMIC_ACQ_REL)) != NULL) {
+    frame->flags |= dropped->flags;
+    recycle_frame(dropped);
+  }
+  __atomic_store_n(&pending_frame, frame, __ATOMIC_RELEASE);
+  sem_post(&frames_available);
+  return t3_true;
+}
+
+/** Initialize output_state_lock.
+
+    The lock is recursive, because ::t3_term_can_draw takes it as well, and is also used while
+    setting up the output state.
+*/
+static void init_output_state_lock(void) {
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&output_state_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+/** @internal
+    @brief Lock the output state shared between the writer thread and the calling thread. */
+void _t3_lock_output_state(void) {
+  pthread_once(&output_state_lock_once, init_output_state_lock);
+  pthread_mutex_lock(&output_state_lock);
+}
+
+/** @internal
+    @brief Unlock the output state shared between the writer thread and the calling thread. */
+void _t3_unlock_output_state(void) { pthread_mutex_unlock(&output_state_lock); }
+
+#else
+t3_bool _t3_start_async_output(void) { return t3_false; }
+void _t3_stop_async_output(void) {}
+t3_bool _t3_async_output_active(void) { return t3_false; }
+void _t3_async_request(int flags) { (void)flags; }
+t3_bool _t3_async_publish(t3_bool show_cursor, int cursor_y, int cursor_x, t3_bool sync_output) {
+  (void)show_cursor;
+  (void)cursor_y;
+  (void)cursor_x;
+  (void)sync_output;
+  return t3_false;
+}
+void _t3_lock_output_state(void) {}
+void _t3_unlock_output_state(void) {}
+#endif
@@ -0,0 +1,34 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_ASYNC_OUTPUT_H
+#define T3_ASYNC_OUTPUT_H
+
+#include "window_api.h"
+
+/* Requests that are handled by the writer thread before it emits the next frame. */
+#define ASYNC_REDRAW 1      /* Clear the terminal and redraw all lines. */
+#define ASYNC_DETECT_SIZE 2 /* Send the terminal size detection query. */
+
+T3_WINDOW_LOCAL extern t3_bool _t3_async_output;
+
+T3_WINDOW_LOCAL t3_bool _t3_start_async_output(void);
+T3_WINDOW_LOCAL void _t3_stop_async_output(void);
+T3_WINDOW_LOCAL t3_bool _t3_async_output_active(void);
+T3_WINDOW_LOCAL void _t3_async_request(int flags);
+T3_WINDOW_LOCAL t3_bool _t3_async_publish(t3_bool show_cursor, int cursor_y, int cursor_x,
+                                          t3_bool sync_output);
+T3_WINDOW_LOCAL void _t3_lock_output_state(void);
+T3_WINDOW_LOCAL void _t3_unlock_output_state(void);
+
+#endif
@@ -0,0 +1,187 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <string.h>
+
+#include "capability.h"
+#include "frame_buffer.h"
+/* The curses header file defines too many symbols that get in the way of our
+   own, so we have a separate C file which exports only those functions that
+   we actually use. */
+#include "curses_interface.h"
+
+/** @internal Maximum number of bytes required to print an @c int in decimal. */
+#define MAX_INT_DIGITS 11
+
+compiled_cap_t _t3_cup_cap, /**< @internal Pre-processed version of @c _t3_cup. */
+    _t3_hpa_cap,            /**< @internal Pre-processed version of @c _t3_hpa. */
+    _t3_vpa_cap,            /**< @internal Pre-processed version of @c _t3_vpa. */
+    _t3_cud_cap,            /**< @internal Pre-processed version of @c _t3_cud. */
+    _t3_cuf_cap;            /**< @internal Pre-processed version of @c _t3_cuf. */
+
+/** Add a literal character to a ::compiled_cap_t.
+    @return A boolean indicating whether there was enough space to store the character.
+*/
+static t3_bool add_literal(compiled_cap_t *compiled, size_t *literal_fill, char c) {
+  if (*literal_fill >= COMPILED_CAP_MAX_LITERAL) {
+    return t3_false;
+  }
+
+  if (compiled->nr_of_parts == 0 || compiled->parts[compiled->nr_of_parts - 1].param >= 0) {
+    if (compiled->nr_of_parts == COMPILED_CAP_MAX_PARTS) {
+      return t3_false;
+    }
+    compiled->parts[compiled->nr_of_parts].param = -1;
+    compiled->parts[compiled->nr_of_parts].offset = (unsigned char)*literal_fill;
+    compiled->parts[compiled->nr_of_parts].length = 0;
+    compiled->nr_of_parts++;
+  }
+  compiled->literal[(*literal_fill)++] = c;
+  compiled->parts[compiled->nr_of_parts - 1].length++;
+  return t3_true;
+}
+
+/** @internal
+    @brief Pre-process a parameterized terminfo string.
+    @param compiled The location to store the result.
+    @param cap The terminfo string, which must remain valid while @p compiled is in use. May be
+        @c NULL.
+    @param nr_of_args The number of parameters the terminfo string takes (at most 2).
+
+    Only strings consisting of literal text, @c %%, @c %i, and @c %p[12]%d are pre-processed. For
+    all other strings, and those that contain padding information, @c compiled->simple is set to
+    ::t3_false, which causes ::_t3_putp_cap to fall back to @c tparm and @c tputs.
+*/
+void _t3_compile_cap(compiled_cap_t *compiled, const char *cap, int nr_of_args) {
+  size_t literal_fill = 0;
+  t3_bool param_seen = t3_false;
+  const char *ptr;
+
+  compiled->cap = cap;
+  compiled->simple = t3_false;
+  compiled->increment = t3_false;
+  compiled->nr_of_parts = 0;
+
+  if (cap == NULL) {
+    return;
+  }
+
+  for (ptr = cap; *ptr != 0; ptr++) {
+    if (*ptr == '$' && ptr[1] == '<') {
+      /* Padding information. */
+      return;
+    } else if (*ptr != '%') {
+      if (!add_literal(compiled, &literal_fill, *ptr)) {
+        return;
+      }
+      continue;
+    }
+
+    ptr++;
+    if (*ptr == '%') {
+      if (!add_literal(compiled, &literal_fill, '%')) {
+        return;
+      }
+    } else if (*ptr == 'i') {
+      /* %i only affects parameters that are printed after it. */
+      if (param_seen) {
+        return;
+      }
+      compiled->increment = t3_true;
+    } else if (*ptr == 'p' && ptr[1] >= '1' && ptr[1] < '1' + nr_of_args && ptr[2] == '%' &&
+               ptr[3] == 'd') {
+      if (compiled->nr_of_parts == COMPILED_CAP_MAX_PARTS) {
+        return;
+      }
+      compiled->parts[compiled->nr_of_parts].param = (signed char)(ptr[1] - '1');
+      compiled->parts[compiled->nr_of_parts].offset = 0;
+      compiled->parts[compiled->nr_of_parts].length = 0;
+      compiled->nr_of_parts++;
+      param_seen = t3_true;
+      ptr += 3;
+    } else {
+      return;
+    }
+  }
+  compiled->simple = t3_true;
+}
+
+/** @internal
+    @brief Print an @c int in decimal.
+    @param dst The location to store the result, which must be at least 11 bytes large.
+    @return The number of bytes written to @p dst.
+*/
+size_t _t3_format_int(char *dst, int value) {
+  char digits[MAX_INT_DIGITS];
+  unsigned int abs_value;
+  size_t nr_of_digits = 0, length = 0;
+
+  if (value < 0) {
+    dst[length++] = '-';
+    abs_value = -(unsigned int)value;
+  } else {
+    abs_value = value;
+  }
+
+  do {
+    digits[nr_of_digits++] = '0' + abs_value % 10;
+    abs_value /= 10;
+  } while (abs_value != 0);
+
+  while (nr_of_digits > 0) {
+    dst[length++] = digits[--nr_of_digits];
+  }
+  return length;
+}
+
+/** @internal
+    @brief Send a pre-processed terminfo string to the terminal.
+    @param compiled The pre-processed terminfo string.
+    @param arg1 The first parameter.
+    @param arg2 The second parameter. Ignored for strings that take a single parameter.
+*/
+void _t3_putp_cap(const compiled_cap_t *compiled, int arg1, int arg2) {
+  char *start, *dst;
+  int i;
+
+  if (compiled->cap == NULL) {
+    return;
+  }
+
+  if (!compiled->simple) {
+    _t3_putp(_t3_tparm((char *)compiled->cap, 2, arg1, arg2));
+    return;
+  }
+
+  if ((start = _t3_frame_reserve(COMPILED_CAP_MAX_LITERAL +
+                                 COMPILED_CAP_MAX_PARTS * MAX_INT_DIGITS)) == NULL) {
+    return;
+  }
+
+  if (compiled->increment) {
+    arg1++;
+    arg2++;
+  }
+
+  for (i = 0, dst = start; i < compiled->nr_of_parts; i++) {
+    if (compiled->parts[i].param < 0) {
+      memcpy(dst, compiled->literal + compiled->parts[i].offset, compiled->parts[i].length);
+      dst += compiled->parts[i].length;
+    } else {
+      dst += _t3_format_int(dst, compiled->parts[i].param == 0 ? arg1 : arg2);
+    }
+  }
+  _t3_frame_commit(dst - start);
+}
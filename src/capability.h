@@ -0,0 +1,49 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_CAPABILITY_H
+#define T3_CAPABILITY_H
+
+#include <stddef.h>
+
+#include "window_api.h"
+
+#define COMPILED_CAP_MAX_PARTS 8
+#define COMPILED_CAP_MAX_LITERAL 32
+
+/* Pre-processed form of a parameterized terminfo string. Most terminals use
+   very simple strings for cursor movement, consisting only of literal text,
+   the %i operator and decimal printing of the parameters. These are
+   translated into a list of parts which can be formatted without
+   interpreting the terminfo string. Strings using any other features, or
+   that contain padding information, are passed to tparm and tputs. */
+typedef struct {
+  const char *cap; /* The original terminfo string, or NULL if not available. */
+  t3_bool simple;  /* Whether the string could be pre-processed. */
+  t3_bool increment;
+  int nr_of_parts;
+  struct {
+    signed char param; /* Parameter to print (0 based) or -1 for literal text. */
+    unsigned char offset, length;
+  } parts[COMPILED_CAP_MAX_PARTS];
+  char literal[COMPILED_CAP_MAX_LITERAL];
+} compiled_cap_t;
+
+T3_WINDOW_LOCAL extern compiled_cap_t _t3_cup_cap, _t3_hpa_cap, _t3_vpa_cap, _t3_cud_cap,
+    _t3_cuf_cap;
+
+T3_WINDOW_LOCAL void _t3_compile_cap(compiled_cap_t *compiled, const char *cap, int nr_of_args);
+T3_WINDOW_LOCAL void _t3_putp_cap(const compiled_cap_t *compiled, int arg1, int arg2);
+T3_WINDOW_LOCAL size_t _t3_format_int(char *dst, int value);
+
+#endif
@@ -0,0 +1,53 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_CHAR_INFO_H
+#define T3_CHAR_INFO_H
+
+#include <unictype.h>
+
+#include "generated/chardata.h"
+#include "utf8.h"
+
+/* Lookup of the properties of a codepoint, which must be below 0x110000. If USE_FLAT_CHARDATA is
+   defined, the properties of the codepoints in the Basic Multilingual Plane are all stored in a
+   single byte in a flat table. Otherwise, and for the other planes, the width and version are
+   looked up in the multi-level table from chardata.h, and the general category using
+   libunistring. The flat table only flags the codepoints with a known version, so the general
+   category of the other codepoints, which may be assigned in a later Unicode version, is looked up
+   using libunistring as well. Note that these macros evaluate their argument more than once. */
+#ifdef USE_FLAT_CHARDATA
+#include "generated/chardata_bmp.h"
+
+#define _t3_char_width(c) \
+  ((int)(((c) < 0x10000 ? _t3_window_chardata_bmp[c] : get_chardata(c)) >> 6) - 1)
+#define _t3_char_available_since(c)                                       \
+  ((c) < 0x10000 ? _t3_window_chardata_bmp[c] & CHARDATA_BMP_VERSION_MASK \
+                 : get_chardata(c) & 0x3f)
+#define _t3_char_bmp_known(c) \
+  ((c) < 0x10000 &&         \
+   (_t3_window_chardata_bmp[c] & CHARDATA_BMP_VERSION_MASK) != CHARDATA_BMP_VERSION_UNKNOWN)
+#define _t3_char_is_control(c)                                                     \
+  (_t3_char_bmp_known(c) ? (_t3_window_chardata_bmp[c] & CHARDATA_BMP_CONTROL) != 0 \
+                         : uc_is_general_category_withtable((c), T3_UTF8_CONTROL_MASK))
+#define _t3_char_is_mark(c)                                                     \
+  (_t3_char_bmp_known(c) ? (_t3_window_chardata_bmp[c] & CHARDATA_BMP_MARK) != 0 \
+                         : uc_is_general_category_withtable((c), UC_CATEGORY_MASK_M))
+#else
+#define _t3_char_width(c) ((int)(get_chardata(c) >> 6) - 1)
+#define _t3_char_available_since(c) (get_chardata(c) & 0x3f)
+#define _t3_char_is_control(c) uc_is_general_category_withtable((c), T3_UTF8_CONTROL_MASK)
+#define _t3_char_is_mark(c) uc_is_general_category_withtable((c), UC_CATEGORY_MASK_M)
+#endif
+
+#endif
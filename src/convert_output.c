@@ -19,22 +19,57 @@
 #include <stdlib.h>
 #include <string.h>
 #include <transcript/transcript.h>
-#include <unictype.h>
 #include <uninorm.h>
 
+#include "async_output.h"
+#include "char_info.h"
 #include "convert_output.h"
-#include "curses_interface.h"
-#include "generated/chardata.h"
+#include "frame_buffer.h"
+#include "generated/gb18030.h"
 #include "internal.h"
+#include "stats.h"
 #include "utf8.h"
 #include "window.h"
 
 #define CONV_BUFFER_LEN (160)
 
+#define CONVERSION_CACHE_SIZE 512
+#define CONVERSION_CACHE_TEXT_LEN 16
+
+/* Entry in the cache of converted graphemes, used for multi-byte character sets. */
+typedef struct {
+  uint8_t key_length;   /* Length of the UTF-8 text, or 0 for an unused entry. */
+  uint8_t value_length; /* Length of the converted text. */
+  uint8_t replacements; /* Number of replacement characters to print before the converted text. */
+  char key[CONVERSION_CACHE_TEXT_LEN];
+  char value[CONVERSION_CACHE_TEXT_LEN];
+} conversion_cache_entry_t;
+
 static char *output_buffer;
 static size_t output_buffer_size, output_buffer_idx;
 static transcript_t *output_converter = NULL;
 
+/* The terminal uses GB18030, which is converted without using ::output_converter. */
+static t3_bool output_gb18030;
+/* The terminal uses a single byte character set, which is converted using ::single_byte_table. */
+static t3_bool single_byte_output;
+/* Reverse mapping for single byte character sets, in pages of 256 codepoints. Each entry holds
+   the byte value plus one, or 0 if the codepoint is not available. */
+static uint16_t *single_byte_table[256];
+/* Cache of converted graphemes for other character sets, or @c NULL if the character set is
+   stateful. */
+static conversion_cache_entry_t *conversion_cache;
+/* ASCII characters are converted to themselves. */
+static t3_bool ascii_compatible;
+
+/* Results of ::can_draw for single codepoints, computed one page of 256 codepoints at a time when
+   first needed. They depend on the character set and the detected terminal capabilities, so they
+   are discarded when the output conversion is initialized. */
+typedef struct {
+  uint8_t drawable[32];
+} drawable_page_t;
+static drawable_page_t *drawable_pages[0x110000 >> 8];
+
 static char *nfc_output;
 static size_t nfc_output_size;
 static uint32_t replacement_char = '?';
@@ -43,6 +78,10 @@ static size_t replacement_char_length = 1;
 
 static void convert_replacement_char(uint32_t c);
 static void print_replacement_character(void);
+static t3_bool can_draw(const char *str, size_t str_len);
+static t3_bool can_draw_cached(const char *str, size_t str_len);
+static void free_conversion_data(void);
+static void free_drawable_pages(void);
 
 /** @internal
     @brief Initialize the output buffer used for accumulating output characters.
@@ -67,6 +106,8 @@ void _t3_free_output_buffer(void) {
     transcript_close_converter(output_converter);
     output_converter = NULL;
   }
+  free_conversion_data();
+  free_drawable_pages();
   if (nfc_output != NULL) {
     free(nfc_output);
     nfc_output_size = 0;
@@ -74,9 +115,108 @@ void _t3_free_output_buffer(void) {
   }
 }
 
+/** Free the pages of ::single_byte_table. */
+static void free_single_byte_table(void) {
+  int i;
+
+  for (i = 0; i < 256; i++) {
+    free(single_byte_table[i]);
+    single_byte_table[i] = NULL;
+  }
+}
+
+/** Free the tables used for fast conversion of the output. */
+static void free_conversion_data(void) {
+  free_single_byte_table();
+  free(conversion_cache);
+  conversion_cache = NULL;
+  output_gb18030 = t3_false;
+  single_byte_output = t3_false;
+  ascii_compatible = t3_false;
+}
+
+/** Check whether ::output_converter converts all ASCII characters to themselves. */
+static t3_bool check_ascii_compatible(void) {
+  char ascii[128], converted[2 * sizeof(ascii)], *converted_ptr = converted;
+  const char *ascii_ptr = ascii;
+  int i;
+
+  for (i = 0; i < 128; i++) {
+    ascii[i] = i;
+  }
+  if (transcript_from_unicode(output_converter, &ascii_ptr, ascii + sizeof(ascii), &converted_ptr,
+                              converted + sizeof(converted),
+                              TRANSCRIPT_END_OF_TEXT) != TRANSCRIPT_SUCCESS ||
+      transcript_from_unicode_flush(output_converter, &converted_ptr,
+                                    converted + sizeof(converted)) != TRANSCRIPT_SUCCESS) {
+    transcript_from_unicode_reset(output_converter);
+    return t3_false;
+  }
+  return converted_ptr - converted == sizeof(ascii) && memcmp(ascii, converted, sizeof(ascii)) == 0;
+}
+
+/** Build ::single_byte_table by converting all byte values with ::output_converter.
+    @return A boolean indicating whether the character set is a single byte character set.
+
+    The character set is considered a single byte character set if every byte value is either
+    invalid or converts to a single character. If it is not, or if not enough memory is available,
+    the partially built table must be freed by the caller.
+*/
+static t3_bool init_single_byte_table(void) {
+  char input, output[16], *output_ptr;
+  const char *input_ptr;
+  size_t codepoint_len;
+  uint32_t c;
+  int i;
+
+  for (i = 0; i < 256; i++) {
+    input = i;
+    input_ptr = &input;
+    output_ptr = output;
+    switch (transcript_to_unicode(output_converter, &input_ptr, &input + 1, &output_ptr,
+                                  output + sizeof(output), 0)) {
+      case TRANSCRIPT_SUCCESS:
+        break;
+      case TRANSCRIPT_INCOMPLETE:
+        /* The byte starts a multi-byte sequence. */
+        transcript_to_unicode_reset(output_converter);
+        return t3_false;
+      default:
+        /* Unassigned or illegal byte value. */
+        transcript_to_unicode_reset(output_converter);
+        continue;
+    }
+
+    codepoint_len = output_ptr - output;
+    if (codepoint_len == 0) {
+      /* The byte only changes the state of the conversion. */
+      transcript_to_unicode_reset(output_converter);
+      return t3_false;
+    }
+    c = t3_utf8_get(output, &codepoint_len);
+    if (codepoint_len != (size_t)(output_ptr - output) || c >= 0x10000) {
+      return t3_false;
+    }
+
+    if (single_byte_table[c >> 8] == NULL &&
+        (single_byte_table[c >> 8] = calloc(256, sizeof(uint16_t))) == NULL) {
+      return t3_false;
+    }
+    /* If several byte values map to the same character, use the first. */
+    if (single_byte_table[c >> 8][c & 0xff] == 0) {
+      single_byte_table[c >> 8][c & 0xff] = i + 1;
+    }
+  }
+  return t3_true;
+}
+
 /** @internal
     @brief Initialize the characterset conversion used for output.
     @param encodig The encoding to convert to.
+
+    Besides opening the converter, this prepares the fastest available method of conversion: a
+    native encoder for GB18030, a reverse lookup table for single byte character sets, or a cache
+    of converted graphemes for all other character sets.
 */
 t3_bool _t3_init_output_converter(const char *encoding) {
   char squashed_name[10];
@@ -84,6 +224,8 @@ t3_bool _t3_init_output_converter(const char *encoding) {
   if (output_converter != NULL) {
     transcript_close_converter(output_converter);
   }
+  free_conversion_data();
+  free_drawable_pages();
 
   transcript_normalize_name(encoding, squashed_name, sizeof(squashed_name));
   if (strcmp(squashed_name, "utf8") == 0) {
@@ -97,6 +239,41 @@ t3_bool _t3_init_output_converter(const char *encoding) {
 
   convert_replacement_char(replacement_char);
 
+  ascii_compatible = check_ascii_compatible();
+  if (strcmp(squashed_name, "gb18030") == 0) {
+    output_gb18030 = t3_true;
+  } else if (init_single_byte_table()) {
+    single_byte_output = t3_true;
+  } else {
+    free_single_byte_table();
+    /* If the allocation fails, all output is simply converted with output_converter. */
+    conversion_cache = calloc(CONVERSION_CACHE_SIZE, sizeof(conversion_cache_entry_t));
+  }
+
+  return t3_true;
+}
+
+/** Ensure that at least @p n more bytes fit in the output buffer. */
+static t3_bool ensure_output_space(size_t n) {
+  size_t new_size;
+  char *retval;
+
+  if (output_buffer_size - output_buffer_idx >= n) {
+    return t3_true;
+  }
+
+  new_size = output_buffer_size == 0 ? 160 : output_buffer_size;
+  while (new_size - output_buffer_idx < n) {
+    if ((SIZE_MAX >> 1) < new_size) {
+      return t3_false;
+    }
+    new_size <<= 1;
+  }
+  if ((retval = realloc(output_buffer, new_size)) == NULL) {
+    return t3_false;
+  }
+  output_buffer = retval;
+  output_buffer_size = new_size;
   return t3_true;
 }
 
@@ -111,17 +288,8 @@ t3_bool _t3_init_output_converter(const char *encoding) {
     used from term_update.
 */
 t3_bool t3_term_putc(char c) {
-  if (output_buffer_idx >= output_buffer_size) {
-    char *retval;
-
-    if ((SIZE_MAX >> 1) > output_buffer_size) {
-      output_buffer_size <<= 1;
-    }
-    retval = realloc(output_buffer, output_buffer_size);
-    if (retval == NULL) {
-      return t3_false;
-    }
-    output_buffer = retval;
+  if (output_buffer_idx >= output_buffer_size && !ensure_output_space(1)) {
+    return t3_false;
   }
   output_buffer[output_buffer_idx++] = c;
   return t3_true;
@@ -136,13 +304,7 @@ t3_bool t3_term_putc(char c) {
     Contrary to the previous comment for users of the library, this function is also
     used from term_update.
 */
-t3_bool t3_term_puts(const char *s) {
-  t3_bool retval = t3_true;
-  while (*s != 0) {
-    retval &= t3_term_putc(*s++);
-  }
-  return retval;
-}
+t3_bool t3_term_puts(const char *s) { return t3_term_putn(s, strlen(s)); }
 
 /** Add a string to the output buffer.
     @ingroup t3window_term
@@ -155,141 +317,665 @@ t3_bool t3_term_puts(const char *s) {
     used from term_update.
 */
 t3_bool t3_term_putn(const char *s, size_t n) {
-  t3_bool retval = t3_true;
-  for (; n != 0; n--) {
-    retval &= t3_term_putc(*s++);
+  if (!ensure_output_space(n)) {
+    return t3_false;
+  }
+  memcpy(output_buffer + output_buffer_idx, s, n);
+  output_buffer_idx += n;
+  return t3_true;
+}
+
+/** Reserve space in the output buffer for writing directly.
+    @ingroup t3window_term
+    @param n The number of bytes to reserve.
+    @return A pointer to at least @p n writable bytes, or @c NULL if not enough memory is available.
+
+    This allows the callback set with ::t3_term_set_user_callback to generate its output in place,
+    instead of building it elsewhere and copying it with ::t3_term_putn. The written bytes are only
+    added to the output by calling ::t3_term_commit. Any other call that adds to the output buffer
+    invalidates the returned pointer. Like ::t3_term_putn, this function should not be used outside
+    the callback set with ::t3_term_set_user_callback.
+*/
+char *t3_term_reserve(size_t n) {
+  if (!ensure_output_space(n)) {
+    return NULL;
   }
-  return retval;
+  return output_buffer + output_buffer_idx;
+}
+
+/** Add bytes written to the space returned by ::t3_term_reserve to the output buffer.
+    @ingroup t3window_term
+    @param n The number of bytes to add, which must not exceed the number of bytes reserved.
+*/
+void t3_term_commit(size_t n) { output_buffer_idx += n; }
+
+/** Append @p n bytes to the normalized output in ::nfc_output.
+    @param fill The number of bytes already in ::nfc_output, which is updated.
+    @return @c t3_false if no memory could be allocated for the data, @c t3_true otherwise.
+*/
+static t3_bool append_nfc_output(size_t *fill, const char *data, size_t n) {
+  if (nfc_output_size - *fill < n) {
+    size_t new_size = nfc_output_size == 0 ? 160 : nfc_output_size;
+    char *retval;
+
+    while (new_size - *fill < n) {
+      new_size <<= 1;
+    }
+    if ((retval = realloc(nfc_output, new_size)) == NULL) {
+      return t3_false;
+    }
+    nfc_output = retval;
+    nfc_output_size = new_size;
+  }
+  memcpy(nfc_output + *fill, data, n);
+  *fill += n;
+  return t3_true;
+}
+
+/** Find the first character in the output buffer that may change under NFC normalization.
+    @param idx The offset at which to start searching.
+    @param segment_start Location to store the offset of the last character before the found
+        character which is not affected by normalization, or @p idx if there is none.
+    @return The offset of the found character, or ::output_buffer_idx if there is none.
+*/
+static size_t find_nfc_unstable(size_t idx, size_t *segment_start) {
+  size_t codepoint_len;
+
+  *segment_start = idx;
+  while (idx < output_buffer_idx) {
+    size_t ascii = _t3_ascii_prefix_length(output_buffer + idx, output_buffer_idx - idx);
+    if (ascii > 0) {
+      idx += ascii;
+      *segment_start = idx - 1;
+      continue;
+    }
+    codepoint_len = output_buffer_idx - idx;
+    if (_t3_nfc_unstable(t3_utf8_get(output_buffer + idx, &codepoint_len))) {
+      return idx;
+    }
+    *segment_start = idx;
+    idx += codepoint_len;
+  }
+  return idx;
+}
+
+/** Normalize the parts of the output buffer that may change under NFC normalization.
+    @param idx The offset of the first character that may change, as returned by
+        ::find_nfc_unstable.
+    @param segment_start The offset of the segment containing the character at @p idx.
+    @param fill Location to store the length of the result in ::nfc_output.
+    @return @c t3_false if no memory could be allocated for the result, @c t3_true otherwise.
+
+    A part to normalize starts at the last character before the first changing character that is
+    not affected by normalization, because that character may combine with the following ones. It
+    ends at the next character that does not change, as that can not combine with the preceding
+    ones.
+*/
+static t3_bool normalize_segments(size_t idx, size_t segment_start, size_t *fill) {
+  size_t copied = 0, codepoint_len, normalized_len;
+  uint8_t segment_buffer[64], *normalized;
+  t3_bool appended;
+
+  *fill = 0;
+  while (idx < output_buffer_idx) {
+    /* Find the end of the sequence of characters that may change. */
+    do {
+      codepoint_len = output_buffer_idx - idx;
+      if (!_t3_nfc_unstable(t3_utf8_get(output_buffer + idx, &codepoint_len))) {
+        break;
+      }
+      idx += codepoint_len;
+    } while (idx < output_buffer_idx);
+
+    if (!append_nfc_output(fill, output_buffer + copied, segment_start - copied)) {
+      return t3_false;
+    }
+    normalized_len = sizeof(segment_buffer);
+    normalized = u8_normalize(UNINORM_NFC, (const uint8_t *)output_buffer + segment_start,
+                              idx - segment_start, segment_buffer, &normalized_len);
+    if (normalized == NULL) {
+      /* Invalid UTF-8. Pass it on as is, like the text that is not normalized. */
+      appended = append_nfc_output(fill, output_buffer + segment_start, idx - segment_start);
+    } else {
+      appended = append_nfc_output(fill, (const char *)normalized, normalized_len);
+      if (normalized != segment_buffer) {
+        free(normalized);
+      }
+    }
+    if (!appended) {
+      return t3_false;
+    }
+    copied = idx;
+    idx = find_nfc_unstable(idx, &segment_start);
+  }
+  return append_nfc_output(fill, output_buffer + copied, output_buffer_idx - copied);
+}
+
+/** Normalize the contents of the output buffer to NFC.
+    @param length Location to store the length of the result.
+    @return A pointer to the normalized text.
+
+    Almost all output is ASCII or already in NFC, so only the parts of the output buffer that
+    contain characters that may change under normalization are passed to the normalizer (see
+    ::normalize_segments). If no part needs normalization, the output buffer itself is returned.
+    The output buffer is also returned if there is not enough memory for the normalized text, as
+    printing the text unnormalized is better than not printing it at all.
+*/
+static const char *normalize_output_buffer(size_t *length) {
+  size_t idx, segment_start;
+
+  if ((idx = find_nfc_unstable(0, &segment_start)) == output_buffer_idx ||
+      !normalize_segments(idx, segment_start, length)) {
+    *length = output_buffer_idx;
+    return output_buffer;
+  }
+  return nfc_output;
 }
 
 /** @internal
-    @brief Print the characters in the output buffer.
+    @brief Encode a codepoint in GB18030.
+    @param c The codepoint to encode.
+    @param dst The location to store the result, which must have space for at least 4 bytes.
+    @return The number of bytes stored in @p dst, or 0 if @p c can not be encoded.
 */
-void _t3_output_buffer_print(void) {
-  char *tmp_nfc_output;
-  size_t nfc_output_len;
-  if (output_buffer_idx == 0) {
-    return;
+size_t _t3_gb18030_put(uint32_t c, char *dst) {
+  uint32_t index;
+
+  if (c < 0x80) {
+    dst[0] = c;
+    return 1;
+  } else if (c < 0x10000) {
+    uint_fast16_t two_byte;
+    int low, high, mid;
+
+    if (c >= 0xD800 && c <= 0xDFFF) {
+      return 0;
+    }
+    if ((two_byte = _t3_gb18030_get_two_byte(c)) != 0) {
+      dst[0] = two_byte >> 8;
+      dst[1] = two_byte & 0xff;
+      return 2;
+    }
+    /* Find the range of four-byte sequences that contains c. */
+    for (low = 0, high = GB18030_FOUR_BYTE_RANGES; high - low > 1;) {
+      mid = (low + high) / 2;
+      if (_t3_gb18030_four_byte_start[mid] <= c) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    index = _t3_gb18030_four_byte_index[low] + (c - _t3_gb18030_four_byte_start[low]);
+  } else if (c < 0x110000) {
+    index = 189000 + (c - 0x10000);
+  } else {
+    return 0;
   }
 
-  nfc_output_len = nfc_output_size;
-  tmp_nfc_output = (char *)u8_normalize(UNINORM_NFC, (const uint8_t *)output_buffer,
-                                        output_buffer_idx, (uint8_t *)nfc_output, &nfc_output_len);
-  if (tmp_nfc_output != nfc_output) {
-    free(nfc_output);
-    nfc_output = tmp_nfc_output;
-    nfc_output_size = nfc_output_len;
+  dst[3] = 0x30 + index % 10;
+  index /= 10;
+  dst[2] = 0x81 + index % 126;
+  index /= 126;
+  dst[1] = 0x30 + index % 10;
+  dst[0] = 0x81 + index / 10;
+  return 4;
+}
+
+/** Convert UTF-8 text to GB18030 and add it to the frame buffer. */
+static void write_gb18030(const char *str, size_t n) {
+  size_t idx = 0, ascii, codepoint_len = 0, encoded_len;
+  char *output, *output_start;
+
+  while (idx < n) {
+    /* A single input byte may result in up to four output bytes, if it is invalid UTF-8. */
+    if ((output_start = _t3_frame_reserve(4 * (n - idx))) == NULL) {
+      return;
+    }
+    output = output_start;
+    while (idx < n) {
+      ascii = _t3_ascii_prefix_length(str + idx, n - idx);
+      memcpy(output, str + idx, ascii);
+      output += ascii;
+      idx += ascii;
+      if (idx == n) {
+        break;
+      }
+      codepoint_len = n - idx;
+      if ((encoded_len = _t3_gb18030_put(t3_utf8_get(str + idx, &codepoint_len), output)) == 0) {
+        break;
+      }
+      output += encoded_len;
+      idx += codepoint_len;
+    }
+    _t3_frame_commit(output - output_start);
+    if (idx < n) {
+      print_replacement_character();
+      idx += codepoint_len;
+    }
   }
+}
 
-  // FIXME: for GB18030 we should also take the first option. However, it does need conversion...
-  if (output_converter == NULL) {
-#if 1
-    size_t idx, codepoint_len, output_start;
-    uint32_t c;
-    uint_fast8_t available_since;
-    /* Filter out combining characters if the terminal is known not to support them (e.g.
-       gnome-terminal).
-       If the character is accepted, then don't do anything. If the character has to be filtered
-       out, print
-       the acceptable characters up to now and then print replacement characters if needed, moving
-       the
-       acceptable pointer up to after the character to skip. */
-    /* FIXME: should we filter out other zero-width characters? */
-    for (idx = 0, output_start = 0; idx < nfc_output_len; idx += codepoint_len) {
-      codepoint_len = nfc_output_len - idx;
-      c = t3_utf8_get(nfc_output + idx, &codepoint_len);
-      available_since = get_chardata(c) & 0x3f;
+/** Add UTF-8 text to the frame buffer, converting it if the terminal uses GB18030. */
+static void write_unicode_text(const char *str, size_t n) {
+  if (output_gb18030) {
+    write_gb18030(str, n);
+  } else {
+    _t3_frame_write(str, n);
+  }
+}
 
-      if (_t3_term_combining < available_since &&
-          uc_is_general_category_withtable(c, UC_CATEGORY_MASK_M)) {
-        fwrite(nfc_output + output_start, 1, idx - output_start, _t3_putp_file);
-        /* For non-zero width combining characters, print a replacement character. */
-        if (t3_utf8_wcwidth(c) == 1) {
-          print_replacement_character();
-        }
-        output_start = idx + codepoint_len;
+/** Print text for a terminal using UTF-8 or GB18030.
+
+    Both encodings can represent all characters, but combining and double width characters are
+    filtered out if the terminal is known not to support them (e.g. gnome-terminal).
+*/
+static void print_filtered(const char *text, size_t text_len) {
+  size_t idx, codepoint_len, output_start;
+  uint32_t c;
+  uint_fast8_t available_since;
+
+  /* If the character is accepted, then don't do anything. If the character has to be filtered
+     out, print the acceptable characters up to now and then print replacement characters if
+     needed, moving the acceptable pointer up to after the character to skip. */
+  /* FIXME: should we filter out other zero-width characters? */
+  for (idx = 0, output_start = 0; idx < text_len; idx += codepoint_len) {
+    codepoint_len = _t3_ascii_prefix_length(text + idx, text_len - idx);
+    if (codepoint_len > 0) {
+      continue;
+    }
+    codepoint_len = text_len - idx;
+    c = t3_utf8_get(text + idx, &codepoint_len);
+    available_since = _t3_char_available_since(c);
+
+    if (_t3_term_combining < available_since && _t3_char_is_mark(c)) {
+      write_unicode_text(text + output_start, idx - output_start);
+      /* For non-zero width combining characters, print a replacement character. */
+      if (_t3_char_width(c) == 1) {
+        print_replacement_character();
       }
-      if (_t3_term_double_width < available_since && t3_utf8_wcwidth(c) == 2) {
-        if (_t3_term_double_width < 0) {
-          fwrite(nfc_output + output_start, 1, idx - output_start, _t3_putp_file);
-          print_replacement_character();
-          print_replacement_character();
-        } else {
-          fwrite(nfc_output + output_start, 1, idx - output_start + codepoint_len, _t3_putp_file);
-          /* Add a space to compensate for the lack of double width characters. */
-          fputc(' ', _t3_putp_file);
+      output_start = idx + codepoint_len;
+    }
+    if (_t3_term_double_width < available_since && _t3_char_width(c) == 2) {
+      if (_t3_term_double_width < 0) {
+        write_unicode_text(text + output_start, idx - output_start);
+        print_replacement_character();
+        print_replacement_character();
+      } else {
+        write_unicode_text(text + output_start, idx - output_start + codepoint_len);
+        /* Add a space to compensate for the lack of double width characters. */
+        _t3_frame_putc(' ');
+      }
+      output_start = idx + codepoint_len;
+    }
+  }
+  write_unicode_text(text + output_start, idx - output_start);
+}
+
+/** Print text for a terminal using a single byte character set, using ::single_byte_table. */
+static void print_single_byte(const char *text, size_t text_len) {
+  size_t idx = 0, ascii, codepoint_len = 0;
+  char *output, *output_start;
+  uint32_t c = 0;
+  int width;
+
+  while (idx < text_len) {
+    /* Each character results in at most one byte. */
+    if ((output_start = _t3_frame_reserve(text_len - idx)) == NULL) {
+      return;
+    }
+    output = output_start;
+    while (idx < text_len) {
+      if (ascii_compatible) {
+        ascii = _t3_ascii_prefix_length(text + idx, text_len - idx);
+        memcpy(output, text + idx, ascii);
+        output += ascii;
+        idx += ascii;
+        if (idx == text_len) {
+          break;
         }
-        output_start = idx + codepoint_len;
       }
+      codepoint_len = text_len - idx;
+      c = t3_utf8_get(text + idx, &codepoint_len);
+      if (c >= 0x10000 || single_byte_table[c >> 8] == NULL ||
+          single_byte_table[c >> 8][c & 0xff] == 0) {
+        break;
+      }
+      *output++ = single_byte_table[c >> 8][c & 0xff] - 1;
+      idx += codepoint_len;
     }
-    fwrite(nfc_output + output_start, 1, idx - output_start, _t3_putp_file);
-#else
-    fwrite(nfc_output, 1, nfc_output_len, _t3_putp_file);
-#endif
-  } else {
-    char conversion_output[CONV_BUFFER_LEN], *conversion_output_ptr;
-    const char *conversion_input_ptr = nfc_output,
-               *conversion_input_end = nfc_output + nfc_output_len;
+    _t3_frame_commit(output - output_start);
+    if (idx < text_len) {
+      for (width = t3_utf8_wcwidth(c); width > 0; width--) {
+        print_replacement_character();
+      }
+      idx += codepoint_len;
+    }
+  }
+}
 
-    /* Convert UTF-8 sequence into current output encoding using transcript_from_unicode. */
-    while (conversion_input_ptr < conversion_input_end) {
-      conversion_output_ptr = conversion_output;
-      switch (transcript_from_unicode(output_converter, &conversion_input_ptr, conversion_input_end,
-                                      &conversion_output_ptr, conversion_output + CONV_BUFFER_LEN,
-                                      TRANSCRIPT_END_OF_TEXT)) {
-        default: {
-          /* Conversion did not succeed on this character; print chars with length equal to char.
-             Possible reasons include unassigned characters, fallbacks. Others should not happen. */
-          size_t char_len = conversion_input_end - conversion_input_ptr;
-          int width;
-          uint32_t c;
-
-          /* First write all output that has been converted. */
-          if (conversion_output_ptr != conversion_output) {
-            fwrite(conversion_output, 1, conversion_output_ptr - conversion_output, _t3_putp_file);
-          }
-
-          c = t3_utf8_get(conversion_input_ptr, &char_len);
-          conversion_input_ptr += char_len;
-
-          /* Ensure that the conversion ends in the 'initial state', because after this we will
-             be outputing replacement characters. */
+/** Print text for a terminal using any other character set, using ::output_converter.
+
+    This is also used for parts of the output that can not be handled by ::print_cached.
+*/
+static void print_converted(const char *text, size_t text_len) {
+  char *conversion_output, *conversion_output_ptr;
+  const char *conversion_input_ptr = text, *conversion_input_end = text + text_len;
+
+  /* Convert UTF-8 sequence into current output encoding using transcript_from_unicode. The
+     converted output is written directly into the frame buffer. */
+  while (conversion_input_ptr < conversion_input_end) {
+    if ((conversion_output = _t3_frame_reserve(CONV_BUFFER_LEN)) == NULL) {
+      break;
+    }
+    conversion_output_ptr = conversion_output;
+    switch (transcript_from_unicode(output_converter, &conversion_input_ptr, conversion_input_end,
+                                    &conversion_output_ptr, conversion_output + CONV_BUFFER_LEN,
+                                    TRANSCRIPT_END_OF_TEXT)) {
+      default: {
+        /* Conversion did not succeed on this character; print chars with length equal to char.
+           Possible reasons include unassigned characters, fallbacks. Others should not happen. */
+        size_t char_len = conversion_input_end - conversion_input_ptr;
+        int width;
+        uint32_t c;
+
+        /* First commit all output that has been converted. */
+        _t3_frame_commit(conversion_output_ptr - conversion_output);
+
+        c = t3_utf8_get(conversion_input_ptr, &char_len);
+        conversion_input_ptr += char_len;
+
+        /* Ensure that the conversion ends in the 'initial state', because after this we will
+           be outputing replacement characters. */
+        if ((conversion_output = _t3_frame_reserve(CONV_BUFFER_LEN)) != NULL) {
           conversion_output_ptr = conversion_output;
           transcript_from_unicode_flush(output_converter, &conversion_output_ptr,
                                         conversion_output + CONV_BUFFER_LEN);
-          if (conversion_output_ptr != conversion_output) {
-            fwrite(conversion_output, 1, conversion_output_ptr - conversion_output, _t3_putp_file);
-          }
-
-          for (width = t3_utf8_wcwidth(c); width > 0; width--) {
-            print_replacement_character();
-          }
+          _t3_frame_commit(conversion_output_ptr - conversion_output);
+        }
 
-          break;
+        for (width = t3_utf8_wcwidth(c); width > 0; width--) {
+          print_replacement_character();
         }
-        case TRANSCRIPT_ILLEGAL_END:
-          /* This should only happen if there is an incomplete UTF-8 character at the end of
-             the buffer. Not much we can do about that... */
-          break;
-        case TRANSCRIPT_NO_SPACE:
-          /* Not enough space in output buffer. Flush current contents and continue. */
-          fwrite(conversion_output, 1, conversion_output_ptr - conversion_output, _t3_putp_file);
-          break;
-        case TRANSCRIPT_SUCCESS:
-          fwrite(conversion_output, 1, conversion_output_ptr - conversion_output, _t3_putp_file);
-          break;
+
+        break;
       }
+      case TRANSCRIPT_ILLEGAL_END:
+        /* This should only happen if there is an incomplete UTF-8 character at the end of
+           the buffer. Not much we can do about that... */
+        break;
+      case TRANSCRIPT_NO_SPACE:
+        /* Not enough space in output buffer. Commit current contents and continue. */
+      case TRANSCRIPT_SUCCESS:
+        _t3_frame_commit(conversion_output_ptr - conversion_output);
+        break;
     }
-    /* Ensure that the conversion ends in the 'initial state', because after this we will
-       be outputing escape sequences. */
+  }
+  /* Ensure that the conversion ends in the 'initial state', because after this we will
+     be outputing escape sequences. */
+  if ((conversion_output = _t3_frame_reserve(CONV_BUFFER_LEN)) != NULL) {
     conversion_output_ptr = conversion_output;
     transcript_from_unicode_flush(output_converter, &conversion_output_ptr,
                                   conversion_output + CONV_BUFFER_LEN);
-    if (conversion_output_ptr != conversion_output) {
-      fwrite(conversion_output, 1, conversion_output_ptr - conversion_output, _t3_putp_file);
+    _t3_frame_commit(conversion_output_ptr - conversion_output);
+  }
+}
+
+/** Get the length of the grapheme at the start of @p text.
+
+    For the purpose of caching conversions, a grapheme is a character followed by all directly
+    following combining marks, which corresponds to the contents of a single block in the window
+    data.
+*/
+static size_t grapheme_length(const char *text, size_t text_len) {
+  size_t idx, codepoint_len = text_len;
+  uint32_t c;
+
+  t3_utf8_get(text, &codepoint_len);
+  for (idx = codepoint_len; idx < text_len; idx += codepoint_len) {
+    if ((unsigned char)text[idx] < 0x80) {
+      break;
+    }
+    codepoint_len = text_len - idx;
+    c = t3_utf8_get(text + idx, &codepoint_len);
+    if (!_t3_char_is_mark(c)) {
+      break;
+    }
+  }
+  return idx;
+}
+
+/** Convert a grapheme with ::output_converter and store the result in a cache entry.
+    @return A boolean indicating whether the result could be stored.
+
+    If the conversion does not end in the initial state, the character set is stateful and the
+    result of a conversion depends on the preceding text. In that case the conversion cache is
+    disabled.
+*/
+static t3_bool fill_conversion_cache_entry(conversion_cache_entry_t *entry, const char *str,
+                                           size_t n) {
+  const char *input = str;
+  char *output = entry->value, *flush_start;
+  size_t char_len;
+  int width;
+
+  entry->key_length = 0;
+  entry->replacements = 0;
+  for (;;) {
+    switch (transcript_from_unicode(output_converter, &input, str + n, &output,
+                                    entry->value + sizeof(entry->value), TRANSCRIPT_END_OF_TEXT)) {
+      case TRANSCRIPT_SUCCESS:
+        break;
+      case TRANSCRIPT_NO_SPACE:
+      case TRANSCRIPT_ILLEGAL_END:
+        transcript_from_unicode_reset(output_converter);
+        return t3_false;
+      default:
+        /* Only a failure to convert the first character can be cached. Anything else is left to
+           print_converted. */
+        transcript_from_unicode_reset(output_converter);
+        if (input != str || output != entry->value) {
+          return t3_false;
+        }
+        char_len = n;
+        width = t3_utf8_wcwidth(t3_utf8_get(str, &char_len));
+        entry->replacements = width > 0 ? width : 0;
+        input += char_len;
+        continue;
+    }
+    break;
+  }
+
+  flush_start = output;
+  if (transcript_from_unicode_flush(output_converter, &output,
+                                    entry->value + sizeof(entry->value)) != TRANSCRIPT_SUCCESS ||
+      output != flush_start) {
+    transcript_from_unicode_reset(output_converter);
+    free(conversion_cache);
+    conversion_cache = NULL;
+    return t3_false;
+  }
+  memcpy(entry->key, str, n);
+  entry->key_length = n;
+  entry->value_length = output - entry->value;
+  return t3_true;
+}
+
+/** Print a single grapheme using ::conversion_cache.
+    @return A boolean indicating whether the grapheme was printed.
+*/
+static t3_bool print_cached_grapheme(const char *str, size_t n) {
+  conversion_cache_entry_t *entry;
+  uint_fast32_t hash = 2166136261u;
+  size_t i;
+  int replacements;
+
+  if (n > CONVERSION_CACHE_TEXT_LEN) {
+    return t3_false;
+  }
+  /* FNV-1a hash of the UTF-8 text. */
+  for (i = 0; i < n; i++) {
+    hash = ((hash ^ (unsigned char)str[i]) * 16777619u) & 0xffffffffu;
+  }
+  entry = &conversion_cache[hash & (CONVERSION_CACHE_SIZE - 1)];
+
+  if (entry->key_length != n || memcmp(entry->key, str, n) != 0) {
+    if (!fill_conversion_cache_entry(entry, str, n)) {
+      return t3_false;
+    }
+  }
+  for (replacements = entry->replacements; replacements > 0; replacements--) {
+    print_replacement_character();
+  }
+  _t3_frame_write(entry->value, entry->value_length);
+  return t3_true;
+}
+
+/** Print text for a terminal using a multi-byte character set, using ::conversion_cache.
+
+    Converting text with ::output_converter one grapheme at a time is slow, but the same graphemes
+    tend to be printed over and over. The results of the conversions are therefore cached. This
+    only works for character sets where the conversion of a grapheme does not depend on the
+    preceding text, which is checked by ::fill_conversion_cache_entry.
+*/
+static void print_cached(const char *text, size_t text_len) {
+  size_t idx = 0, ascii, length;
+
+  while (idx < text_len) {
+    if (conversion_cache == NULL) {
+      print_converted(text + idx, text_len - idx);
+      return;
+    }
+    if (ascii_compatible) {
+      ascii = _t3_ascii_prefix_length(text + idx, text_len - idx);
+      /* The last ASCII character may combine with the following characters. */
+      if (ascii > 0 && idx + ascii < text_len) {
+        ascii--;
+      }
+      _t3_frame_write(text + idx, ascii);
+      idx += ascii;
+      if (idx == text_len) {
+        break;
+      }
+    }
+    length = grapheme_length(text + idx, text_len - idx);
+    if (!print_cached_grapheme(text + idx, length)) {
+      print_converted(text + idx, length);
     }
+    idx += length;
+  }
+}
+
+/** @internal
+    @brief Print the characters in the output buffer.
+*/
+void _t3_output_buffer_print(void) {
+  const char *text;
+  size_t text_len, frame_length;
+  if (output_buffer_idx == 0) {
+    return;
+  }
+  frame_length = _t3_frame_length();
+
+  text = normalize_output_buffer(&text_len);
+
+  if (output_converter == NULL || output_gb18030) {
+    print_filtered(text, text_len);
+  } else if (single_byte_output) {
+    print_single_byte(text, text_len);
+  } else if (conversion_cache != NULL) {
+    print_cached(text, text_len);
+  } else {
+    print_converted(text, text_len);
   }
   output_buffer_idx = 0;
+  STATS_ADD(text_bytes, _t3_frame_length() - frame_length);
+}
+
+/** @internal
+    @brief Determine whether text needs processing by ::_t3_output_buffer_print before it can be
+        sent to a UTF-8 terminal.
+    @param str The UTF-8 encoded text.
+    @param n The length of @p str.
+
+    Text needs processing if it may change under NFC normalization, or if it contains combining or
+    double width characters that the terminal is not known to support. The result depends on the
+    detected terminal capabilities, so it must be recomputed when detection finishes.
+*/
+t3_bool _t3_output_needs_filter(const char *str, size_t n) {
+  size_t idx = 0, codepoint_len;
+  uint_fast8_t available_since;
+  uint32_t c;
+
+  while (idx < n) {
+    idx += _t3_ascii_prefix_length(str + idx, n - idx);
+    if (idx == n) {
+      break;
+    }
+    codepoint_len = n - idx;
+    c = t3_utf8_get(str + idx, &codepoint_len);
+    idx += codepoint_len;
+
+    if (_t3_nfc_unstable(c)) {
+      return t3_true;
+    }
+    available_since = _t3_char_available_since(c);
+    if (_t3_term_combining < available_since && _t3_char_is_mark(c)) {
+      return t3_true;
+    }
+    if (_t3_term_double_width < available_since && _t3_char_width(c) == 2) {
+      return t3_true;
+    }
+  }
+  return t3_false;
+}
+
+/** @internal
+    @brief Output the text of a block from the window data.
+    @param str The UTF-8 encoded text.
+    @param n The length of @p str.
+    @param needs_filter The result of ::_t3_output_needs_filter for @p str.
+
+    Text in the window data is normalized when it is added to a window. Unless it needs filtering,
+    it can therefore be copied to the frame buffer as is if the terminal uses UTF-8, or encoded
+    directly if the terminal uses GB18030.
+*/
+void _t3_output_block_text(const char *str, size_t n, t3_bool needs_filter) {
+  size_t frame_length;
+
+  if (needs_filter || (output_converter != NULL && !output_gb18030)) {
+    t3_term_putn(str, n);
+    return;
+  }
+  _t3_output_buffer_print();
+  frame_length = _t3_frame_length();
+  write_unicode_text(str, n);
+  STATS_ADD(text_bytes, _t3_frame_length() - frame_length);
+}
+
+/** @internal
+    @brief Reserve space in the frame buffer for copying the text of blocks directly.
+    @param n The number of bytes to reserve.
+    @return A pointer to at least @p n writable bytes, or @c NULL if text must be passed to
+        ::_t3_output_block_text.
+
+    Text that does not need filtering is copied as is if the terminal uses UTF-8. This allows the
+    text of a run of blocks with the same attributes to be copied using a single reservation. The
+    copied text is added to the output by ::_t3_output_commit_text.
+*/
+char *_t3_output_reserve_text(size_t n) {
+  if (output_converter != NULL) {
+    return NULL;
+  }
+  _t3_output_buffer_print();
+  return _t3_frame_reserve(n);
+}
+
+/** @internal
+    @brief Add @p n bytes copied to the space from ::_t3_output_reserve_text to the output.
+*/
+void _t3_output_commit_text(size_t n) {
+  _t3_frame_commit(n);
+  STATS_ADD(text_bytes, n);
 }
 
 /** Determine if the terminal can draw a character.
@@ -310,6 +996,80 @@ void _t3_output_buffer_print(void) {
     screen.
 */
 t3_bool t3_term_can_draw(const char *str, size_t str_len) {
+  t3_bool result;
+
+  /* The conversion state is shared with the writer thread in asynchronous output mode. */
+  _t3_lock_output_state();
+  result = can_draw_cached(str, str_len);
+  _t3_unlock_output_state();
+  return result;
+}
+
+/** Free all pages in ::drawable_pages. */
+static void free_drawable_pages(void) {
+  size_t i;
+
+  for (i = 0; i < sizeof(drawable_pages) / sizeof(drawable_pages[0]); i++) {
+    free(drawable_pages[i]);
+    drawable_pages[i] = NULL;
+  }
+}
+
+/** Determine if the terminal can draw a single codepoint, using ::drawable_pages. */
+static t3_bool can_draw_codepoint(uint32_t c) {
+  drawable_page_t *page = drawable_pages[c >> 8];
+  char buffer[4];
+  uint32_t i;
+
+  if (page == NULL) {
+    if ((page = calloc(1, sizeof(drawable_page_t))) == NULL) {
+      return can_draw(buffer, t3_utf8_put(c, buffer));
+    }
+    for (i = c & ~(uint32_t)0xff; i <= (c | 0xff); i++) {
+      /* Surrogates can not be represented in UTF-8, and are never drawable. */
+      if ((i < 0xD800 || i > 0xDFFF) && can_draw(buffer, t3_utf8_put(i, buffer))) {
+        page->drawable[(i & 0xff) >> 3] |= 1 << (i & 7);
+      }
+    }
+    drawable_pages[c >> 8] = page;
+  }
+  return (page->drawable[(c & 0xff) >> 3] >> (c & 7)) & 1;
+}
+
+/** Determine if the terminal can draw a character, see ::t3_term_can_draw.
+
+    For a single codepoint, the result is looked up in ::drawable_pages. This also holds for
+    strings of several codepoints that are already in NFC, because the terminal can draw those if
+    it can draw each of the codepoints. Only other strings need the full check in ::can_draw.
+*/
+static t3_bool can_draw_cached(const char *str, size_t str_len) {
+  size_t idx, codepoint_len;
+  uint32_t c;
+
+  for (idx = 0; idx < str_len; idx += codepoint_len) {
+    codepoint_len = str_len - idx;
+    c = t3_utf8_get(str + idx, &codepoint_len);
+    /* Invalid UTF-8 is decoded as a U+FFFD of the wrong length. */
+    if (c >= 0x110000 || (c == 0xFFFD && codepoint_len != 3) ||
+        (_t3_nfc_unstable(c) && (idx > 0 || codepoint_len < str_len))) {
+      return can_draw(str, str_len);
+    }
+  }
+  if (str_len == 0) {
+    return can_draw(str, str_len);
+  }
+
+  for (idx = 0; idx < str_len; idx += codepoint_len) {
+    codepoint_len = str_len - idx;
+    if (!can_draw_codepoint(t3_utf8_get(str + idx, &codepoint_len))) {
+      return t3_false;
+    }
+  }
+  return t3_true;
+}
+
+/** Determine if the terminal can draw a character, see ::t3_term_can_draw. */
+static t3_bool can_draw(const char *str, size_t str_len) {
   size_t nfc_output_len;
 
   if (str_len > 1 || nfc_output == NULL) {
@@ -327,7 +1087,7 @@ t3_bool t3_term_can_draw(const char *str, size_t str_len) {
     nfc_output_len = 1;
   }
 
-  if (output_converter == NULL) {
+  if (output_converter == NULL || output_gb18030) {
     size_t idx, codepoint_len;
     uint_fast8_t available_since;
     uint32_t c;
@@ -340,13 +1100,12 @@ t3_bool t3_term_can_draw(const char *str, size_t str_len) {
     for (idx = 0; idx < nfc_output_len; idx += codepoint_len) {
       codepoint_len = nfc_output_len - idx;
       c = t3_utf8_get(nfc_output + idx, &codepoint_len);
-      available_since = get_chardata(c) & 0x3f;
+      available_since = _t3_char_available_since(c);
 
-      if (_t3_term_combining < available_since &&
-          uc_is_general_category_withtable(c, UC_CATEGORY_MASK_M)) {
+      if (_t3_term_combining < available_since && _t3_char_is_mark(c)) {
         return t3_false;
       }
-      if (_t3_term_double_width < available_since && t3_utf8_wcwidth(c) == 2) {
+      if (_t3_term_double_width < available_since && _t3_char_width(c) == 2) {
         return t3_false;
       }
     }
@@ -424,15 +1183,17 @@ static void convert_replacement_char(uint32_t c) {
     capable of Unicode output the Replacement Character is used (codepoint FFFD).
 */
 void t3_term_set_replacement_char(int c) {
+  _t3_lock_output_state();
   replacement_char = c;
   convert_replacement_char(replacement_char);
+  _t3_unlock_output_state();
 }
 
 /** Print the replacement character. */
 static void print_replacement_character(void) {
   if (output_converter == NULL) {
-    fwrite("\xef\xbf\xbd", 1, 3, _t3_putp_file);
+    _t3_frame_write("\xef\xbf\xbd", 3);
   } else {
-    fwrite(replacement_char_str, 1, replacement_char_length, _t3_putp_file);
+    _t3_frame_write(replacement_char_str, replacement_char_length);
   }
 }
@@ -14,11 +14,18 @@
 #ifndef T3_CONVERT_OUTPUT_H
 #define T3_CONVERT_OUTPUT_H
 
+#include <stdint.h>
+
 #include "terminal.h"
 
 T3_WINDOW_LOCAL t3_bool _t3_init_output_buffer(void);
 T3_WINDOW_LOCAL void _t3_free_output_buffer(void);
 T3_WINDOW_LOCAL t3_bool _t3_init_output_converter(const char *encoding);
 T3_WINDOW_LOCAL void _t3_output_buffer_print(void);
+T3_WINDOW_LOCAL t3_bool _t3_output_needs_filter(const char *str, size_t n);
+T3_WINDOW_LOCAL void _t3_output_block_text(const char *str, size_t n, t3_bool needs_filter);
+T3_WINDOW_LOCAL char *_t3_output_reserve_text(size_t n);
+T3_WINDOW_LOCAL void _t3_output_commit_text(size_t n);
+T3_WINDOW_LOCAL size_t _t3_gb18030_put(uint32_t c, char *dst);
 
 #endif
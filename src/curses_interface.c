@@ -20,9 +20,7 @@
 #include <term.h>
 
 #include "curses_interface.h"
-
-FILE *_t3_putp_file; /**< @c FILE struct corresponding to the terminal. Used for tputs in
-                        ::_t3_putp. */
+#include "frame_buffer.h"
 
 #define COPY_BUFFER_SIZE 160
 #define COPY_BUFFER(_name)                          \
@@ -70,12 +68,18 @@ int _t3_tigetflag(const char *name) {
   return tigetflag(name_buffer);
 }
 
-static int writechar(int c) { return fputc(c, _t3_putp_file); }
+static int writechar(int c) { return _t3_frame_putc(c) ? c : EOF; }
 
 void _t3_putp(const char *string) {
   if (string == NULL) {
     return;
   }
+  /* Only strings with padding information need to be interpreted by tputs. All
+     others can be copied into the frame buffer as is. */
+  if (strstr(string, "$<") == NULL) {
+    _t3_frame_puts(string);
+    return;
+  }
   tputs(string, 1, writechar);
 }
 
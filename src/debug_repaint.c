@@ -0,0 +1,322 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_repaint.h"
+#include "internal.h"
+#include "window.h"
+
+/* The repaint debug mode shows which cells each terminal update actually sends to the terminal,
+   by drawing those cells with a tint. This makes it easy to spot programs that defeat the
+   comparison with the terminal contents, for example by rewriting complete lines or changing
+   attributes back and forth.
+
+   The terminal contents recorded by the library never include the tint. Instead, the time at
+   which each cell was tinted is recorded. Once the tint has been shown long enough, the cell is
+   sent again without the tint, even though its contents did not change. The time at which this
+   is needed is reported through t3_term_get_update_timeout.
+
+   Only updates done by the calling thread are tinted, not those done by the writer thread of the
+   asynchronous output mode. */
+
+#define TINT_DURATION 200000 /* Microseconds. */
+/* Number of terminal cells in each direction represented by one cell of the heat map. */
+#define HEAT_MAP_SCALE 4
+#define HEAT_MAP_LEVELS 6
+
+/** @internal One of DEBUG_REPAINT_*, set through the @c debug_repaint option. */
+int _t3_debug_repaint;
+
+/* Time at which each terminal cell was tinted, or 0 if the cell is shown without tint. */
+static int64_t *tint_times;
+/* Number of times each terminal cell was sent to the terminal with changed contents, for the
+   heat map. */
+static unsigned long *repaint_counts;
+static int state_lines, state_width;
+
+/* Per cell of the current line, whether its contents differ from the terminal contents. */
+static char *changed;
+static int current_line;
+static int64_t current_time;
+
+static t3_window_t *heat_map;
+
+static const char heat_map_chars[HEAT_MAP_LEVELS + 1] = " .:+*#";
+static const t3_attr_t heat_map_colors[HEAT_MAP_LEVELS] = {
+    T3_ATTR_BG_DEFAULT, T3_ATTR_BG_BLUE,   T3_ATTR_BG_CYAN,
+    T3_ATTR_BG_GREEN,   T3_ATTR_BG_YELLOW, T3_ATTR_BG_RED};
+
+/** Free the per-cell state. */
+static void free_state(void) {
+  free(tint_times);
+  tint_times = NULL;
+  free(repaint_counts);
+  repaint_counts = NULL;
+  free(changed);
+  changed = NULL;
+  state_lines = 0;
+  state_width = 0;
+}
+
+/** Make sure the state arrays match the size of the terminal.
+
+    When the terminal size changes, all state is discarded. The terminal is redrawn completely in
+    that case anyway.
+*/
+static t3_bool ensure_state(void) {
+  size_t cells;
+
+  if (tint_times != NULL && state_lines == _t3_terminal_window->height &&
+      state_width == _t3_terminal_window->width) {
+    return t3_true;
+  }
+
+  free_state();
+  cells = (size_t)_t3_terminal_window->height * _t3_terminal_window->width;
+  if ((tint_times = calloc(cells, sizeof(int64_t))) == NULL ||
+      (repaint_counts = calloc(cells, sizeof(unsigned long))) == NULL ||
+      (changed = malloc(_t3_terminal_window->width)) == NULL) {
+    free_state();
+    return t3_false;
+  }
+  state_lines = _t3_terminal_window->height;
+  state_width = _t3_terminal_window->width;
+  return t3_true;
+}
+
+/** Mark the cells of @p new_line that are not shown by the terminal according to @p old_line. */
+static void find_changed_cells(const line_data_t *new_line, const line_data_t *old_line) {
+  int new_idx = 0, old_idx = 0, width = new_line->start, old_width = old_line->start;
+  int block_width, i;
+  uint32_t new_block_size, old_block_size = 0;
+  size_t new_block_size_bytes, old_block_size_bytes = 0;
+
+  memset(changed, 0, state_width);
+  while (new_idx < new_line->length) {
+    new_block_size = _t3_get_value(new_line->data + new_idx, &new_block_size_bytes);
+    block_width = _T3_BLOCK_SIZE_TO_WIDTH(new_block_size);
+
+    /* Find the old block at the same position, if any. */
+    while (old_idx < old_line->length) {
+      old_block_size = _t3_get_value(old_line->data + old_idx, &old_block_size_bytes);
+      if (old_width >= width) {
+        break;
+      }
+      old_width += _T3_BLOCK_SIZE_TO_WIDTH(old_block_size);
+      old_idx += (old_block_size >> 1) + old_block_size_bytes;
+    }
+
+    if (old_idx >= old_line->length || old_width != width || old_block_size != new_block_size ||
+        memcmp(old_line->data + old_idx + old_block_size_bytes,
+               new_line->data + new_idx + new_block_size_bytes, new_block_size >> 1) != 0) {
+      for (i = width; i < width + block_width && i < state_width; i++) {
+        changed[i] = 1;
+      }
+    }
+    width += block_width;
+    new_idx += (new_block_size >> 1) + new_block_size_bytes;
+  }
+}
+
+/** Check whether a cell on the current line is covered by the heat map. */
+static t3_bool in_heat_map(int x) {
+  return heat_map != NULL && current_line < t3_win_get_height(heat_map) &&
+         x >= t3_win_get_abs_x(heat_map);
+}
+
+/** @internal
+    @brief Prepare for tinting the cells sent for a terminal line.
+    @param line The terminal line.
+    @param new_line The new contents of the line.
+    @param old_line The contents of the line on the terminal, without tint.
+    @return A boolean indicating whether the line can be tinted.
+*/
+t3_bool _t3_repaint_begin_line(int line, const line_data_t *new_line,
+                               const line_data_t *old_line) {
+  int64_t *times;
+  int i;
+
+  if (!ensure_state() || line >= state_lines) {
+    return t3_false;
+  }
+  current_line = line;
+  current_time = _t3_monotonic_usec();
+  find_changed_cells(new_line, old_line);
+
+  /* Cells outside the new contents are either untouched, which means they were not tinted, or
+     are cleared without tint. */
+  times = tint_times + (size_t)line * state_width;
+  for (i = 0; i < new_line->start && i < state_width; i++) {
+    times[i] = 0;
+  }
+  for (i = new_line->start + new_line->width; i < state_width; i++) {
+    times[i] = 0;
+  }
+  return t3_true;
+}
+
+/** @internal
+    @brief Check whether a cell must be sent to remove its tint, even if its contents are unchanged.
+*/
+t3_bool _t3_repaint_forced(int x) {
+  int64_t tint_time;
+
+  if (x < 0 || x >= state_width) {
+    return t3_false;
+  }
+  tint_time = tint_times[(size_t)current_line * state_width + x];
+  return tint_time != 0 && current_time - tint_time >= TINT_DURATION;
+}
+
+/** @internal
+    @brief Determine the attributes to use for sending a block to the terminal.
+    @param x The column at which the block is drawn.
+    @param width The width of the block.
+    @param attrs The attributes of the block.
+    @return The attributes to send, with the tint applied if appropriate.
+
+    Changed blocks are tinted. Unchanged blocks may be sent as well, for example to remove the tint
+    of an earlier update, or because that is cheaper than moving the cursor. These keep their
+    current tint, unless it has been shown long enough. Tinting unchanged blocks that were not
+    tinted yet would cause an endless series of updates, as each removal of a tint would tint the
+    surrounding cells.
+*/
+t3_attr_t _t3_repaint_tint(int x, int width, t3_attr_t attrs) {
+  int64_t *times;
+  unsigned long *counts;
+  t3_bool tint;
+  int i;
+
+  if (x < 0 || x >= state_width || in_heat_map(x)) {
+    return attrs;
+  }
+
+  times = tint_times + (size_t)current_line * state_width;
+  counts = repaint_counts + (size_t)current_line * state_width;
+  tint = changed[x] || (times[x] != 0 && !_t3_repaint_forced(x));
+  for (i = x; i < x + width && i < state_width; i++) {
+    if (changed[x]) {
+      times[i] = current_time;
+      counts[i]++;
+    } else if (!tint) {
+      times[i] = 0;
+    }
+  }
+
+  if (!tint) {
+    return attrs;
+  }
+  /* Without color, reverse video is the only attribute that is reliably visible. */
+  if (_t3_colors > 0) {
+    return (attrs & ~T3_ATTR_BG_MASK) | T3_ATTR_BG_MAGENTA;
+  }
+  return attrs ^ T3_ATTR_REVERSE;
+}
+
+/** @internal
+    @brief Draw the accumulated repaint counts in a window in the top-right corner of the terminal.
+
+    This should be called before compositing the terminal contents.
+*/
+void _t3_repaint_paint_heat_map(void) {
+  int height = (_t3_terminal_window->height + HEAT_MAP_SCALE - 1) / HEAT_MAP_SCALE;
+  int width = (_t3_terminal_window->width + HEAT_MAP_SCALE - 1) / HEAT_MAP_SCALE;
+  unsigned long *sums, max = 0;
+  int y, x, level;
+
+  if (!ensure_state()) {
+    return;
+  }
+
+  if (heat_map == NULL) {
+    if ((heat_map = t3_win_new(NULL, height, width, 0, state_width - width, INT_MIN)) == NULL) {
+      return;
+    }
+    t3_win_show(heat_map);
+  } else if (t3_win_get_height(heat_map) != height || t3_win_get_width(heat_map) != width) {
+    if (!t3_win_resize(heat_map, height, width)) {
+      return;
+    }
+    t3_win_move(heat_map, 0, state_width - width);
+  }
+
+  if ((sums = calloc((size_t)height * width, sizeof(unsigned long))) == NULL) {
+    return;
+  }
+  for (y = 0; y < state_lines; y++) {
+    for (x = 0; x < state_width; x++) {
+      sums[(y / HEAT_MAP_SCALE) * width + x / HEAT_MAP_SCALE] +=
+          repaint_counts[(size_t)y * state_width + x];
+    }
+  }
+  for (x = 0; x < height * width; x++) {
+    if (sums[x] > max) {
+      max = sums[x];
+    }
+  }
+
+  t3_win_lock(heat_map);
+  for (y = 0; y < height; y++) {
+    t3_win_set_paint(heat_map, y, 0);
+    for (x = 0; x < width; x++) {
+      /* Levels are relative to the most repainted area, such that the differences stay visible. */
+      level = sums[y * width + x] == 0
+                  ? 0
+                  : 1 + (int)((sums[y * width + x] - 1) * (HEAT_MAP_LEVELS - 1) / max);
+      t3_win_addch(heat_map, heat_map_chars[level], _t3_colors > 0 ? heat_map_colors[level] : 0);
+    }
+  }
+  t3_win_unlock(heat_map);
+  free(sums);
+}
+
+/** @internal
+    @brief Get the time until a tinted cell should be restored.
+    @return -1 if no cells are tinted, or otherwise the number of milliseconds until the next
+        update is needed to remove a tint.
+*/
+int _t3_repaint_timeout(void) {
+  int64_t earliest = 0, now, remaining;
+  size_t i, cells = (size_t)state_lines * state_width;
+
+  if (tint_times == NULL) {
+    return -1;
+  }
+  for (i = 0; i < cells; i++) {
+    if (tint_times[i] != 0 && (earliest == 0 || tint_times[i] < earliest)) {
+      earliest = tint_times[i];
+    }
+  }
+  if (earliest == 0) {
+    return -1;
+  }
+  now = _t3_monotonic_usec();
+  remaining = earliest + TINT_DURATION - now;
+  return remaining <= 0 ? 0 : (int)((remaining + 999) / 1000);
+}
+
+/** @internal
+    @brief Free all memory used by the repaint debug mode.
+*/
+void _t3_free_debug_repaint(void) {
+  free_state();
+  if (heat_map != NULL) {
+    t3_win_del(heat_map);
+    heat_map = NULL;
+  }
+}
@@ -0,0 +1,37 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_DEBUG_REPAINT_H
+#define T3_DEBUG_REPAINT_H
+
+#include "internal.h"
+#include "window_api.h"
+
+/* Values for _t3_debug_repaint. */
+enum {
+  DEBUG_REPAINT_OFF,
+  DEBUG_REPAINT_TINT,    /* Tint the cells sent to the terminal. */
+  DEBUG_REPAINT_HEAT_MAP /* Also show the accumulated repaint counts in a corner of the terminal. */
+};
+
+T3_WINDOW_LOCAL extern int _t3_debug_repaint;
+
+T3_WINDOW_LOCAL t3_bool _t3_repaint_begin_line(int line, const line_data_t *new_line,
+                                               const line_data_t *old_line);
+T3_WINDOW_LOCAL t3_bool _t3_repaint_forced(int x);
+T3_WINDOW_LOCAL t3_attr_t _t3_repaint_tint(int x, int width, t3_attr_t attrs);
+T3_WINDOW_LOCAL void _t3_repaint_paint_heat_map(void);
+T3_WINDOW_LOCAL int _t3_repaint_timeout(void);
+T3_WINDOW_LOCAL void _t3_free_debug_repaint(void);
+
+#endif
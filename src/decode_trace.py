@@ -0,0 +1,77 @@
+#!/usr/bin/python
+# Decode a trace dump written by t3_term_trace_dump.
+#
+# The records of all threads are merged and printed in order of time, with the time in
+# microseconds relative to the first record and the time since the previous record of the
+# same thread.
+
+import sys, struct
+
+MAGIC = b"T3TRACE\0"
+BYTE_ORDER_MARK = 0x01020304
+
+# Event names and argument names. These must match the TRACE_* values in trace.h.
+events = {
+	1: ("frame_begin", []),
+	2: ("frame_end", ["lines", "pending", "complete"]),
+	3: ("line_composite", ["line", "width"]),
+	4: ("line_emit", ["line", "bytes"]),
+	5: ("write", ["requested", "result", "errno"]),
+	6: ("input_read", ["result", "char", "errno"]),
+	7: ("position_report", ["row", "column", "report"]),
+	8: ("mode_report", ["mode", "value"]),
+	9: ("size_detected", ["lines", "columns"]),
+	10: ("async_frame_begin", ["requests"]),
+	11: ("async_frame_end", ["lines", "bytes", "result"]),
+}
+
+def read_dump(data):
+	if not data.startswith(MAGIC):
+		raise ValueError("not a trace dump")
+	offset = len(MAGIC)
+	for order in ("<", ">"):
+		if struct.unpack_from(order + "I", data, offset)[0] == BYTE_ORDER_MARK:
+			break
+	else:
+		raise ValueError("unknown byte order")
+	record_size = struct.unpack_from(order + "I", data, offset + 4)[0]
+	record_format = order + "QHHiii"
+	if record_size != struct.calcsize(record_format):
+		raise ValueError("unsupported record size %d" % record_size)
+	offset += 8
+
+	records = []
+	while offset < len(data):
+		thread, count = struct.unpack_from(order + "II", data, offset)
+		offset += 8
+		for i in range(count):
+			records.append(struct.unpack_from(record_format, data, offset))
+			offset += record_size
+	records.sort(key=lambda record: record[0])
+	return records
+
+def main():
+	if len(sys.argv) != 2:
+		sys.stderr.write("Usage: decode_trace.py <trace dump>\n")
+		sys.exit(1)
+
+	with open(sys.argv[1], "rb") as dump:
+		try:
+			records = read_dump(dump.read())
+		except (ValueError, struct.error) as error:
+			sys.stderr.write("Error reading %s: %s\n" % (sys.argv[1], error))
+			sys.exit(1)
+
+	if len(records) == 0:
+		return
+	start = records[0][0]
+	last_time = {}
+	for time, event, thread, arg0, arg1, arg2 in records:
+		name, arg_names = events.get(event, ("event_%d" % event, ["arg0", "arg1", "arg2"]))
+		args = " ".join("%s=%d" % (arg_name, value) for arg_name, value in zip(arg_names, (arg0, arg1, arg2)))
+		delta = time - last_time.get(thread, time)
+		last_time[thread] = time
+		print("%12d %+9d [%d] %s %s" % (time - start, delta, thread, name, args))
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,254 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAS_SELECT_H
+#include <sys/select.h>
+#else
+#include <sys/time.h>
+#include <sys/types.h>
+#endif
+
+#include "frame_buffer.h"
+#include "internal.h"
+#include "stats.h"
+#include "trace.h"
+
+/* All output to the terminal, be it control sequences or (converted) text, is
+   accumulated in a single buffer owned by the library. The buffer is only
+   written to the terminal when explicitly flushed, which normally happens once
+   at the end of each terminal update. This means that a complete frame is
+   usually handed to the kernel in a single system call.
+
+   Text that needs no conversion is copied straight from the terminal lines into the frame buffer,
+   so each byte of text is copied exactly once before it is written. Writing the text from the
+   terminal lines with writev instead would not pay off: in the line data, the text of every cell
+   is preceded by its block size and attributes, so an I/O vector would be needed for every few
+   bytes of text. Moreover, in non-blocking mode, unsent output must survive changes to the
+   terminal lines. */
+
+#define FRAME_BUFFER_INITIAL_SIZE 4096
+
+static char *frame_buffer;
+static size_t frame_buffer_size, frame_buffer_fill;
+/* Number of bytes at the start of the frame buffer that have already been written to the terminal.
+   This is only non-zero if the terminal was not able to accept all data without blocking. */
+static size_t frame_buffer_written;
+
+/** Ensure that at least @p n more bytes fit in the frame buffer. */
+static t3_bool ensure_frame_space(size_t n) {
+  size_t new_size;
+  char *retval;
+
+  if (frame_buffer_size - frame_buffer_fill >= n) {
+    return t3_true;
+  }
+
+  new_size = frame_buffer_size == 0 ? FRAME_BUFFER_INITIAL_SIZE : frame_buffer_size;
+  while (new_size - frame_buffer_fill < n) {
+    if ((SIZE_MAX >> 1) < new_size) {
+      return t3_false;
+    }
+    new_size <<= 1;
+  }
+
+  if ((retval = realloc(frame_buffer, new_size)) == NULL) {
+    return t3_false;
+  }
+  frame_buffer = retval;
+  frame_buffer_size = new_size;
+  return t3_true;
+}
+
+/** @internal
+    @brief Add bytes to the frame buffer.
+    @param data The bytes to add.
+    @param n The number of bytes in @p data.
+*/
+t3_bool _t3_frame_write(const char *data, size_t n) {
+  if (!ensure_frame_space(n)) {
+    return t3_false;
+  }
+  memcpy(frame_buffer + frame_buffer_fill, data, n);
+  frame_buffer_fill += n;
+  return t3_true;
+}
+
+/** @internal
+    @brief Add a single byte to the frame buffer.
+*/
+t3_bool _t3_frame_putc(char c) {
+  if (frame_buffer_fill >= frame_buffer_size && !ensure_frame_space(1)) {
+    return t3_false;
+  }
+  frame_buffer[frame_buffer_fill++] = c;
+  return t3_true;
+}
+
+/** @internal
+    @brief Add a nul-terminated string to the frame buffer.
+*/
+t3_bool _t3_frame_puts(const char *s) { return _t3_frame_write(s, strlen(s)); }
+
+/** @internal
+    @brief Reserve space in the frame buffer for writing directly.
+    @param n The number of bytes to reserve.
+    @return A pointer to at least @p n writable bytes, or @c NULL on allocation failure.
+
+    The reserved space only becomes part of the output after calling ::_t3_frame_commit. Any
+    other call that adds data to the frame buffer invalidates the returned pointer.
+*/
+char *_t3_frame_reserve(size_t n) {
+  if (!ensure_frame_space(n)) {
+    return NULL;
+  }
+  return frame_buffer + frame_buffer_fill;
+}
+
+/** @internal
+    @brief Add @p n bytes previously written to the space from ::_t3_frame_reserve to the output.
+*/
+void _t3_frame_commit(size_t n) { frame_buffer_fill += n; }
+
+/** @internal
+    @brief Get the number of bytes currently in the frame buffer.
+
+    The returned value can be used with ::_t3_frame_get and ::_t3_frame_truncate to inspect or
+    undo output added after this call.
+*/
+size_t _t3_frame_length(void) { return frame_buffer_fill; }
+
+/** @internal
+    @brief Get a pointer to the data in the frame buffer at offset @p offset.
+
+    The returned pointer is invalidated by any call that adds data to the frame buffer.
+*/
+char *_t3_frame_get(size_t offset) { return frame_buffer + offset; }
+
+/** @internal
+    @brief Discard all data in the frame buffer after the first @p length bytes.
+*/
+void _t3_frame_truncate(size_t length) {
+  if (length < frame_buffer_fill) {
+    frame_buffer_fill = length;
+  }
+}
+
+/** @internal
+    @brief Get the number of bytes at the start of the frame buffer that were already written.
+
+    All bytes between this offset and ::_t3_frame_length are still waiting to be written to the
+    terminal. Data before this offset must not be modified or truncated.
+*/
+size_t _t3_frame_written_length(void) { return frame_buffer_written; }
+
+/** @internal
+    @brief Remove the data already written to the terminal from the frame buffer.
+
+    This moves the data still waiting to be written to the start of the frame buffer, which
+    invalidates all offsets previously obtained from ::_t3_frame_length.
+*/
+void _t3_frame_compact(void) {
+  if (frame_buffer_written == 0) {
+    return;
+  }
+  memmove(frame_buffer, frame_buffer + frame_buffer_written,
+          frame_buffer_fill - frame_buffer_written);
+  frame_buffer_fill -= frame_buffer_written;
+  frame_buffer_written = 0;
+}
+
+/** Wait until the terminal is ready to accept more output.
+
+    This is needed if the terminal file descriptor is in non-blocking mode, either
+    through ::t3_term_set_nonblocking_output or because somebody set it behind our
+    back.
+*/
+static void wait_for_output(void) {
+  fd_set outset;
+
+  FD_ZERO(&outset);
+  FD_SET(_t3_terminal_out_fd, &outset);
+  select(_t3_terminal_out_fd + 1, NULL, &outset, NULL, NULL);
+}
+
+/** Write as much of the frame buffer as possible to the terminal.
+    @param block Boolean indicating whether to wait until the terminal accepts more data.
+    @return A boolean indicating whether no errors occurred.
+
+    Partial writes and interrupted system calls are handled by retrying with
+    the remaining data. On error, the remaining contents of the frame buffer are
+    discarded, to prevent unlimited growth of the buffer.
+*/
+static t3_bool write_frame(t3_bool block) {
+  while (frame_buffer_written < frame_buffer_fill) {
+    ssize_t retval = write(_t3_terminal_out_fd, frame_buffer + frame_buffer_written,
+                           frame_buffer_fill - frame_buffer_written);
+    TRACE(TRACE_WRITE, frame_buffer_fill - frame_buffer_written, retval, retval < 0 ? errno : 0);
+    if (retval < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (!block) {
+          return t3_true;
+        }
+        wait_for_output();
+        continue;
+      }
+      frame_buffer_fill = 0;
+      frame_buffer_written = 0;
+      return t3_false;
+    }
+    frame_buffer_written += retval;
+    STATS_ADD(bytes_written, retval);
+  }
+  frame_buffer_fill = 0;
+  frame_buffer_written = 0;
+  return t3_true;
+}
+
+/** @internal
+    @brief Write the contents of the frame buffer to the terminal.
+    @return A boolean indicating whether all data was written successfully.
+
+    This function waits until the terminal has accepted all data, even if the terminal file
+    descriptor is in non-blocking mode.
+*/
+t3_bool _t3_frame_flush(void) { return write_frame(t3_true); }
+
+/** @internal
+    @brief Write as much of the frame buffer to the terminal as possible without blocking.
+    @return A boolean indicating whether no errors occurred.
+
+    This is only useful if the terminal file descriptor is in non-blocking mode. Any data the
+    terminal does not accept remains in the frame buffer, and ::_t3_frame_written_length indicates
+    how much has been written.
+*/
+t3_bool _t3_frame_try_flush(void) { return write_frame(t3_false); }
+
+/** @internal
+    @brief Free all memory associated with the frame buffer.
+*/
+void _t3_free_frame_buffer(void) {
+  free(frame_buffer);
+  frame_buffer = NULL;
+  frame_buffer_size = 0;
+  frame_buffer_fill = 0;
+  frame_buffer_written = 0;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_FRAME_BUFFER_H
+#define T3_FRAME_BUFFER_H
+
+#include <stddef.h>
+
+#include "window_api.h"
+
+T3_WINDOW_LOCAL t3_bool _t3_frame_write(const char *data, size_t n);
+T3_WINDOW_LOCAL t3_bool _t3_frame_putc(char c);
+T3_WINDOW_LOCAL t3_bool _t3_frame_puts(const char *s);
+T3_WINDOW_LOCAL char *_t3_frame_reserve(size_t n);
+T3_WINDOW_LOCAL void _t3_frame_commit(size_t n);
+T3_WINDOW_LOCAL size_t _t3_frame_length(void);
+T3_WINDOW_LOCAL char *_t3_frame_get(size_t offset);
+T3_WINDOW_LOCAL void _t3_frame_truncate(size_t length);
+T3_WINDOW_LOCAL size_t _t3_frame_written_length(void);
+T3_WINDOW_LOCAL void _t3_frame_compact(void);
+T3_WINDOW_LOCAL t3_bool _t3_frame_flush(void);
+T3_WINDOW_LOCAL t3_bool _t3_frame_try_flush(void);
+T3_WINDOW_LOCAL void _t3_free_frame_buffer(void);
+
+#endif
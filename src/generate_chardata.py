@@ -111,6 +111,8 @@ def main():
 		statrie.write('{0} {1}\n'.format(i, (available_since[i] & 0x3f) | (width << 6)))
 
 	statrie.close()
+	# The flat table for the Basic Multilingual Plane is derived from generated/chardata.c by
+	# generate_chardata_bmp.py, which must be run after this script.
 
 	versions_header = open("generated/versions.h", "w+")
 	versions_header.write("/* This file has been automtically generated by {0}. DO NOT EDIT. */\n".format(os.path.basename(sys.argv[0])))
@@ -0,0 +1,87 @@
+#!/usr/bin/python3
+# Generate the flat table with the properties of the codepoints in the Basic Multilingual Plane.
+#
+# The widths and versions are read from generated/chardata.c, which is generated by
+# generate_chardata.py, such that both tables always agree. The general categories are derived
+# from the Unicode database included with Python. Only the codepoints for which chardata.c lists a
+# version are flagged; for the other codepoints the general category is looked up using
+# libunistring, like it is for the codepoints outside the Basic Multilingual Plane.
+
+import sys, os, re, unicodedata
+
+# General categories of the characters which are flagged. These must correspond to
+# T3_UTF8_CONTROL_MASK and UC_CATEGORY_MASK_M respectively.
+control_categories = set([ "Cs", "Cf", "Co", "Cc", "Zl", "Zp" ])
+mark_categories = set([ "Mn", "Mc", "Me" ])
+
+# The version stored in the flat table for codepoints without a version in chardata.c.
+VERSION_UNKNOWN = 0x0f
+
+def read_array(source, name):
+	match = re.search(r"\b{0}\[[^=]*= \{{(.*?)\}};".format(name), source, re.S)
+	if match is None:
+		sys.stderr.write("Could not find {0} in generated/chardata.c\n".format(name))
+		sys.exit(1)
+	return [int(x, 0) for x in re.findall(r"0x[0-9A-Fa-f]+|\d+", match.group(1))]
+
+def read_chardata():
+	source = open("generated/chardata.c", "r").read()
+	data_2 = read_array(source, "_t3_window_chardata_data_2")
+	data_1 = read_array(source, "_t3_window_chardata_data_1")
+	data_0 = read_array(source, "_t3_window_chardata_data_0")
+	data_idx = read_array(source, "_t3_window_chardata_data_idx")
+
+	# Mirrors get_chardata in generated/chardata.h.
+	def get_chardata(cp):
+		block_0 = data_idx[cp >> 9]
+		block_1 = data_0[block_0 * 32 + ((cp >> 4) & 31)]
+		block_2 = data_1[block_1 * 8 + ((cp >> 1) & 7)]
+		return data_2[block_2 * 2 + (cp & 1)]
+
+	return [get_chardata(cp) for cp in range(0, 0x10000)]
+
+def main():
+	if len(sys.argv) != 1:
+		sys.stderr.write("Usage: generate_chardata_bmp.py\n")
+		sys.exit(1)
+
+	chardata = read_chardata()
+
+	script = os.path.basename(sys.argv[0])
+	header = open("generated/chardata_bmp.h", "w")
+	header.write("/* This file has been automatically generated by {0} from Unicode {1}. DO NOT EDIT. */\n".format(
+		script, unicodedata.unidata_version))
+	header.write("#ifndef T3_WINDOW_CHARDATA_BMP_H\n#define T3_WINDOW_CHARDATA_BMP_H\n")
+	header.write("#include <stdint.h>\n#include \"t3window/window_api.h\"\n")
+	header.write("/* Each entry holds the width plus one in the top two bits, the flags below, and the index of the\n")
+	header.write("   Unicode version in which the character was introduced in the bottom four bits. The flags are\n")
+	header.write("   only valid if the version is not CHARDATA_BMP_VERSION_UNKNOWN. */\n")
+	header.write("#define CHARDATA_BMP_CONTROL 0x20\n#define CHARDATA_BMP_MARK 0x10\n#define CHARDATA_BMP_VERSION_MASK 0x0f\n")
+	header.write("#define CHARDATA_BMP_VERSION_UNKNOWN 0x{0:02x}\n".format(VERSION_UNKNOWN))
+	header.write("T3_WINDOW_LOCAL extern const uint8_t _t3_window_chardata_bmp[65536];\n#endif\n")
+	header.close()
+
+	data = open("generated/chardata_bmp.c", "w")
+	data.write("/* This file has been automatically generated by {0} from Unicode {1}. DO NOT EDIT. */\n".format(
+		script, unicodedata.unidata_version))
+	data.write("#ifdef USE_FLAT_CHARDATA\n#include \"chardata_bmp.h\"\nconst uint8_t _t3_window_chardata_bmp[65536] = {\n")
+	for cp in range(0, 0x10000):
+		version = chardata[cp] & 0x3f
+		if version == 0x3f:
+			version = VERSION_UNKNOWN
+		elif version >= VERSION_UNKNOWN:
+			sys.stderr.write("Too many versions to store in the flat table\n")
+			sys.exit(1)
+		value = (chardata[cp] & 0xc0) | version
+		if version != VERSION_UNKNOWN:
+			category = unicodedata.category(chr(cp))
+			if category in control_categories:
+				value |= 0x20
+			elif category in mark_categories:
+				value |= 0x10
+		data.write("0x%02X,%s" % (value, "\n" if cp % 16 == 15 else " "))
+	data.write("};\n#endif\n")
+	data.close()
+
+if __name__ == "__main__":
+	main()
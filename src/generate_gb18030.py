@@ -0,0 +1,99 @@
+#!/usr/bin/python3
+# Generate the tables used to convert Unicode to GB18030.
+#
+# GB18030 encodes ASCII in one byte, most of the characters from GBK in two bytes, and all other
+# codepoints in four bytes. Four-byte sequences are assigned in codepoint order, so for the Basic
+# Multilingual Plane it suffices to store the linear index of the first codepoint of each range of
+# codepoints with consecutive four-byte sequences. Codepoints above the Basic Multilingual Plane
+# are mapped linearly, starting at index 189000. The mapping is derived from the GB18030 codec
+# included with Python.
+
+import sys, os
+
+PAGE_BITS = 8
+PAGE_SIZE = 1 << PAGE_BITS
+
+def linear_index(encoded):
+	return (((encoded[0] - 0x81) * 10 + (encoded[1] - 0x30)) * 126 + (encoded[2] - 0x81)) * 10 + encoded[3] - 0x30
+
+def main():
+	if len(sys.argv) != 1:
+		sys.stderr.write("Usage: generate_gb18030.py\n")
+		sys.exit(1)
+
+	two_byte = {}
+	four_byte_ranges = []
+	last_four_byte = None
+	for cp in range(0x80, 0x10000):
+		if cp >= 0xD800 and cp <= 0xDFFF:
+			continue
+		encoded = chr(cp).encode("gb18030")
+		if len(encoded) == 2:
+			two_byte[cp] = (encoded[0] << 8) | encoded[1]
+		elif len(encoded) == 4:
+			index = linear_index(encoded)
+			if last_four_byte is None or last_four_byte != (cp - 1, index - 1):
+				four_byte_ranges.append((cp, index))
+			last_four_byte = (cp, index)
+			continue
+		else:
+			sys.stderr.write("Unexpected encoding length for U+{0:04X}\n".format(cp))
+			sys.exit(1)
+		last_four_byte = None
+
+	if linear_index(chr(0x10000).encode("gb18030")) != 189000:
+		sys.stderr.write("Unexpected encoding for U+10000\n")
+		sys.exit(1)
+
+	pages = [(0,) * PAGE_SIZE]
+	page_numbers = { pages[0]: 0 }
+	index = []
+	for start in range(0, 0x10000, PAGE_SIZE):
+		page = tuple(two_byte.get(cp, 0) for cp in range(start, start + PAGE_SIZE))
+		if page not in page_numbers:
+			page_numbers[page] = len(pages)
+			pages.append(page)
+		index.append(page_numbers[page])
+
+	script = os.path.basename(sys.argv[0])
+	header = open("generated/gb18030.h", "w")
+	header.write("/* This file has been automatically generated by {0}. DO NOT EDIT. */\n".format(script))
+	header.write("#ifndef T3_GB18030_H\n#define T3_GB18030_H\n")
+	header.write("#include <stdint.h>\n#include \"t3window/window_api.h\"\n")
+	header.write("#define GB18030_FOUR_BYTE_RANGES {0}\n".format(len(four_byte_ranges)))
+	header.write("T3_WINDOW_LOCAL extern const uint8_t _t3_gb18030_index[{0}];\n".format(len(index)))
+	header.write("T3_WINDOW_LOCAL extern const uint16_t _t3_gb18030_two_byte[{0}][{1}];\n".format(len(pages), PAGE_SIZE))
+	header.write("T3_WINDOW_LOCAL extern const uint16_t _t3_gb18030_four_byte_start[GB18030_FOUR_BYTE_RANGES];\n")
+	header.write("T3_WINDOW_LOCAL extern const uint16_t _t3_gb18030_four_byte_index[GB18030_FOUR_BYTE_RANGES];\n")
+	header.write("/* The two-byte sequence for codepoint x, which must be below 0x10000, or 0 if there is none. */\n")
+	header.write("#define _t3_gb18030_get_two_byte(x) (_t3_gb18030_two_byte[_t3_gb18030_index[(x) >> {0}]][(x) & {1}])\n".format(
+		PAGE_BITS, PAGE_SIZE - 1))
+	header.write("#endif\n")
+	header.close()
+
+	data = open("generated/gb18030.c", "w")
+	data.write("/* This file has been automatically generated by {0}. DO NOT EDIT. */\n".format(script))
+	data.write("#include \"gb18030.h\"\n")
+	data.write("const uint8_t _t3_gb18030_index[{0}] = {{\n".format(len(index)))
+	for i in range(0, len(index), 16):
+		data.write(" ".join("{0},".format(x) for x in index[i:i + 16]) + "\n")
+	data.write("};\n")
+	data.write("const uint16_t _t3_gb18030_two_byte[{0}][{1}] = {{\n".format(len(pages), PAGE_SIZE))
+	for page in pages:
+		data.write("{\n")
+		for i in range(0, PAGE_SIZE, 16):
+			data.write(" ".join("0x{0:04X},".format(x) for x in page[i:i + 16]) + "\n")
+		data.write("},\n")
+	data.write("};\n")
+	data.write("const uint16_t _t3_gb18030_four_byte_start[GB18030_FOUR_BYTE_RANGES] = {\n")
+	for i in range(0, len(four_byte_ranges), 16):
+		data.write(" ".join("0x{0:04X},".format(x[0]) for x in four_byte_ranges[i:i + 16]) + "\n")
+	data.write("};\n")
+	data.write("const uint16_t _t3_gb18030_four_byte_index[GB18030_FOUR_BYTE_RANGES] = {\n")
+	for i in range(0, len(four_byte_ranges), 16):
+		data.write(" ".join("{0},".format(x[1]) for x in four_byte_ranges[i:i + 16]) + "\n")
+	data.write("};\n")
+	data.close()
+
+if __name__ == "__main__":
+	main()
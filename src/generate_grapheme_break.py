@@ -0,0 +1,104 @@
+#!/usr/bin/python3
+# Generate the table used to find the boundaries of extended grapheme clusters (UAX #29).
+#
+# Each codepoint is assigned its Grapheme_Cluster_Break property value. Codepoints which have the
+# Extended_Pictographic property, and Grapheme_Cluster_Break=Other, get a class of their own,
+# because rule GB11 depends on it. The properties are read from GraphemeBreakProperty.txt and
+# emoji-data.txt from the Unicode Character Database.
+
+import sys, os, re
+
+BLOCK_BITS = 7
+BLOCK_SIZE = 1 << BLOCK_BITS
+
+# The order of the classes determines their numeric value, which is used in grapheme.c.
+classes = [ "Other", "CR", "LF", "Control", "Extend", "ZWJ", "Regional_Indicator", "Prepend",
+	"SpacingMark", "L", "V", "T", "LV", "LVT", "Extended_Pictographic" ]
+
+def read_property_file(name, values):
+	version = None
+	data = open(name, "r")
+	for line in data:
+		match = re.match(r"#.*-(\d+\.\d+\.\d+)\.txt", line)
+		if match and version is None:
+			version = match.group(1)
+		line, _, _ = line.partition('#')
+		line = line.strip()
+		if len(line) == 0:
+			continue
+		codepoints, _, value = line.partition(';')
+		value = value.strip()
+		range_start, _, range_end = codepoints.strip().partition("..")
+		range_start = int(range_start, 16)
+		range_end = int(range_end, 16) if range_end != '' else range_start
+		for cp in range(range_start, range_end + 1):
+			values(cp, value)
+	data.close()
+	return version
+
+def main():
+	if len(sys.argv) != 3:
+		sys.stderr.write("Usage: generate_grapheme_break.py <GraphemeBreakProperty file> <emoji-data file>\n")
+		sys.exit(1)
+
+	grapheme_break = [0] * 0x110000
+	def set_grapheme_break(cp, value):
+		if value not in classes:
+			sys.stderr.write("Unknown Grapheme_Cluster_Break value {0}\n".format(value))
+			sys.exit(1)
+		grapheme_break[cp] = classes.index(value)
+	def set_pictographic(cp, value):
+		if value == "Extended_Pictographic" and grapheme_break[cp] == 0:
+			grapheme_break[cp] = classes.index(value)
+
+	version = read_property_file(sys.argv[1], set_grapheme_break)
+	read_property_file(sys.argv[2], set_pictographic)
+
+	blocks = [bytes(BLOCK_SIZE)]
+	block_numbers = { blocks[0]: 0 }
+	index = []
+	for start in range(0, 0x110000, BLOCK_SIZE):
+		block = bytes(grapheme_break[start:start + BLOCK_SIZE])
+		if block not in block_numbers:
+			block_numbers[block] = len(blocks)
+			blocks.append(block)
+		index.append(block_numbers[block])
+
+	if len(blocks) > 256:
+		sys.stderr.write("Too many distinct blocks for an 8-bit index\n")
+		sys.exit(1)
+
+	script = os.path.basename(sys.argv[0])
+	header = open("generated/grapheme_break.h", "w")
+	header.write("/* This file has been automatically generated by {0} from Unicode {1}. DO NOT EDIT. */\n".format(
+		script, version))
+	header.write("#ifndef T3_GRAPHEME_BREAK_H\n#define T3_GRAPHEME_BREAK_H\n")
+	header.write("#include <stdint.h>\n#include \"t3window/window_api.h\"\n")
+	header.write("enum {\n")
+	for value in classes:
+		header.write("\t_T3_GCB_{0},\n".format(value.upper()))
+	header.write("\t_T3_GCB_CLASSES\n};\n")
+	header.write("T3_WINDOW_LOCAL extern const uint8_t _t3_grapheme_break_index[{0}];\n".format(len(index)))
+	header.write("T3_WINDOW_LOCAL extern const uint8_t _t3_grapheme_break_blocks[{0}][{1}];\n".format(len(blocks), BLOCK_SIZE))
+	header.write("/* The grapheme break class of codepoint x, which must be below 0x110000. */\n")
+	header.write("#define _t3_grapheme_break_class(x) (_t3_grapheme_break_blocks[_t3_grapheme_break_index[(x) >> {0}]][(x) & {1}])\n".format(
+		BLOCK_BITS, BLOCK_SIZE - 1))
+	header.write("#endif\n")
+	header.close()
+
+	data = open("generated/grapheme_break.c", "w")
+	data.write("/* This file has been automatically generated by {0} from Unicode {1}. DO NOT EDIT. */\n".format(
+		script, version))
+	data.write("#include \"grapheme_break.h\"\n")
+	data.write("const uint8_t _t3_grapheme_break_index[{0}] = {{\n".format(len(index)))
+	for i in range(0, len(index), 16):
+		data.write(" ".join("{0},".format(x) for x in index[i:i + 16]) + "\n")
+	data.write("};\n")
+	data.write("const uint8_t _t3_grapheme_break_blocks[{0}][{1}] = {{\n".format(len(blocks), BLOCK_SIZE))
+	for block in blocks:
+		data.write("{ " + ", ".join("{0}".format(x) for x in block) + " },\n")
+	data.write("};\n")
+	data.close()
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,94 @@
+#!/usr/bin/python3
+# Generate the table used to find the characters in output that need NFC normalization.
+#
+# A character is marked if it is not a starter (canonical combining class other than 0), if it
+# may not occur in NFC text at all (NFC_Quick_Check=No), or if it may combine with a preceding
+# character (NFC_Quick_Check=Maybe). Text consisting of unmarked characters is already in NFC.
+# The properties are derived from the Unicode database included with Python.
+
+import sys, os, unicodedata
+
+BLOCK_BITS = 8
+BLOCK_SIZE = 1 << BLOCK_BITS
+
+def is_surrogate(cp):
+	return cp >= 0xD800 and cp <= 0xDFFF
+
+def find_unstable():
+	unstable = set()
+	for cp in range(0, 0x110000):
+		if is_surrogate(cp):
+			continue
+		c = chr(cp)
+		if unicodedata.combining(c) != 0:
+			unstable.add(cp)
+		elif unicodedata.normalize("NFC", c) != c:
+			# NFC_Quick_Check=No
+			unstable.add(cp)
+
+		# The second character of each primary composite has NFC_Quick_Check=Maybe.
+		decomposition = unicodedata.decomposition(c).split()
+		if len(decomposition) == 2 and not decomposition[0].startswith("<"):
+			if unicodedata.normalize("NFC", "".join(chr(int(x, 16)) for x in decomposition)) == c:
+				unstable.add(int(decomposition[1], 16))
+
+	# Hangul vowel and trailing consonant jamo combine with the preceding jamo or syllable.
+	unstable.update(range(0x1161, 0x1176))
+	unstable.update(range(0x11A8, 0x11C3))
+	return unstable
+
+def main():
+	if len(sys.argv) != 1:
+		sys.stderr.write("Usage: generate_nfc_quick_check.py\n")
+		sys.exit(1)
+
+	unstable = find_unstable()
+
+	blocks = [bytes(BLOCK_SIZE // 8)]
+	block_numbers = { blocks[0]: 0 }
+	index = []
+	for start in range(0, 0x110000, BLOCK_SIZE):
+		bits = bytearray(BLOCK_SIZE // 8)
+		for cp in range(start, start + BLOCK_SIZE):
+			if cp in unstable:
+				bits[(cp - start) >> 3] |= 1 << (cp & 7)
+		bits = bytes(bits)
+		if bits not in block_numbers:
+			block_numbers[bits] = len(blocks)
+			blocks.append(bits)
+		index.append(block_numbers[bits])
+
+	if len(blocks) > 256:
+		sys.stderr.write("Too many distinct blocks for an 8-bit index\n")
+		sys.exit(1)
+
+	script = os.path.basename(sys.argv[0])
+	header = open("generated/nfc_quick_check.h", "w")
+	header.write("/* This file has been automatically generated by {0} from Unicode {1}. DO NOT EDIT. */\n".format(
+		script, unicodedata.unidata_version))
+	header.write("#ifndef T3_NFC_QUICK_CHECK_H\n#define T3_NFC_QUICK_CHECK_H\n")
+	header.write("#include <stdint.h>\n#include \"t3window/window_api.h\"\n")
+	header.write("T3_WINDOW_LOCAL extern const uint8_t _t3_nfc_qc_index[{0}];\n".format(len(index)))
+	header.write("T3_WINDOW_LOCAL extern const uint8_t _t3_nfc_qc_blocks[{0}][{1}];\n".format(len(blocks), BLOCK_SIZE // 8))
+	header.write("/* Non-zero if codepoint x, which must be below 0x110000, may change under NFC normalization. */\n")
+	header.write("#define _t3_nfc_qc_unstable(x) ((_t3_nfc_qc_blocks[_t3_nfc_qc_index[(x) >> {0}]][((x) >> 3) & {1}] >> ((x) & 7)) & 1)\n".format(
+		BLOCK_BITS, BLOCK_SIZE // 8 - 1))
+	header.write("#endif\n")
+	header.close()
+
+	data = open("generated/nfc_quick_check.c", "w")
+	data.write("/* This file has been automatically generated by {0} from Unicode {1}. DO NOT EDIT. */\n".format(
+		script, unicodedata.unidata_version))
+	data.write("#include \"nfc_quick_check.h\"\n")
+	data.write("const uint8_t _t3_nfc_qc_index[{0}] = {{\n".format(len(index)))
+	for i in range(0, len(index), 16):
+		data.write(" ".join("{0},".format(x) for x in index[i:i + 16]) + "\n")
+	data.write("};\n")
+	data.write("const uint8_t _t3_nfc_qc_blocks[{0}][{1}] = {{\n".format(len(blocks), BLOCK_SIZE // 8))
+	for block in blocks:
+		data.write("{ " + ", ".join("0x{0:02X}".format(x) for x in block) + " },\n")
+	data.write("};\n")
+	data.close()
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,14 @@
+/* This file has been automatically generated by generate_chardata_bmp.py from Unicode 14.0.0. DO NOT EDIT. */
+#ifndef T3_WINDOW_CHARDATA_BMP_H
+#define T3_WINDOW_CHARDATA_BMP_H
+#include <stdint.h>
+#include "t3window/window_api.h"
+/* Each entry holds the width plus one in the top two bits, the flags below, and the index of the
+   Unicode version in which the character was introduced in the bottom four bits. The flags are
+   only valid if the version is not CHARDATA_BMP_VERSION_UNKNOWN. */
+#define CHARDATA_BMP_CONTROL 0x20
+#define CHARDATA_BMP_MARK 0x10
+#define CHARDATA_BMP_VERSION_MASK 0x0f
+#define CHARDATA_BMP_VERSION_UNKNOWN 0x0f
+T3_WINDOW_LOCAL extern const uint8_t _t3_window_chardata_bmp[65536];
+#endif
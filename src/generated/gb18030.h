@@ -0,0 +1,13 @@
+/* This file has been automatically generated by generate_gb18030.py. DO NOT EDIT. */
+#ifndef T3_GB18030_H
+#define T3_GB18030_H
+#include <stdint.h>
+#include "t3window/window_api.h"
+#define GB18030_FOUR_BYTE_RANGES 206
+T3_WINDOW_LOCAL extern const uint8_t _t3_gb18030_index[256];
+T3_WINDOW_LOCAL extern const uint16_t _t3_gb18030_two_byte[130][256];
+T3_WINDOW_LOCAL extern const uint16_t _t3_gb18030_four_byte_start[GB18030_FOUR_BYTE_RANGES];
+T3_WINDOW_LOCAL extern const uint16_t _t3_gb18030_four_byte_index[GB18030_FOUR_BYTE_RANGES];
+/* The two-byte sequence for codepoint x, which must be below 0x10000, or 0 if there is none. */
+#define _t3_gb18030_get_two_byte(x) (_t3_gb18030_two_byte[_t3_gb18030_index[(x) >> 8]][(x) & 255])
+#endif
@@ -0,0 +1,28 @@
+/* This file has been automatically generated by generate_grapheme_break.py from Unicode 16.0.0. DO NOT EDIT. */
+#ifndef T3_GRAPHEME_BREAK_H
+#define T3_GRAPHEME_BREAK_H
+#include <stdint.h>
+#include "t3window/window_api.h"
+enum {
+	_T3_GCB_OTHER,
+	_T3_GCB_CR,
+	_T3_GCB_LF,
+	_T3_GCB_CONTROL,
+	_T3_GCB_EXTEND,
+	_T3_GCB_ZWJ,
+	_T3_GCB_REGIONAL_INDICATOR,
+	_T3_GCB_PREPEND,
+	_T3_GCB_SPACINGMARK,
+	_T3_GCB_L,
+	_T3_GCB_V,
+	_T3_GCB_T,
+	_T3_GCB_LV,
+	_T3_GCB_LVT,
+	_T3_GCB_EXTENDED_PICTOGRAPHIC,
+	_T3_GCB_CLASSES
+};
+T3_WINDOW_LOCAL extern const uint8_t _t3_grapheme_break_index[8704];
+T3_WINDOW_LOCAL extern const uint8_t _t3_grapheme_break_blocks[156][128];
+/* The grapheme break class of codepoint x, which must be below 0x110000. */
+#define _t3_grapheme_break_class(x) (_t3_grapheme_break_blocks[_t3_grapheme_break_index[(x) >> 7]][(x) & 127])
+#endif
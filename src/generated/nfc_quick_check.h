@@ -0,0 +1,10 @@
+/* This file has been automatically generated by generate_nfc_quick_check.py from Unicode 14.0.0. DO NOT EDIT. */
+#ifndef T3_NFC_QUICK_CHECK_H
+#define T3_NFC_QUICK_CHECK_H
+#include <stdint.h>
+#include "t3window/window_api.h"
+T3_WINDOW_LOCAL extern const uint8_t _t3_nfc_qc_index[4352];
+T3_WINDOW_LOCAL extern const uint8_t _t3_nfc_qc_blocks[72][32];
+/* Non-zero if codepoint x, which must be below 0x110000, may change under NFC normalization. */
+#define _t3_nfc_qc_unstable(x) ((_t3_nfc_qc_blocks[_t3_nfc_qc_index[(x) >> 8]][((x) >> 3) & 31] >> ((x) & 7)) & 1)
+#endif
@@ -26,14 +26,23 @@
 
 #include "generated/versions.h"
 #include "internal.h"
-#include "log.h"
+#include "trace.h"
 #include "window.h"
 
 /** @addtogroup t3window_term */
 /** @{ */
 
-/** @internal States for parsing cursor position reports. */
-typedef enum { STATE_INITIAL, STATE_ESC_SEEN, STATE_ROW, STATE_COLUMN } detection_state_t;
+/** @internal States for parsing cursor position reports and mode reports. */
+typedef enum {
+  STATE_INITIAL,
+  STATE_ESC_SEEN,
+  STATE_CSI_SEEN,
+  STATE_ROW,
+  STATE_COLUMN,
+  STATE_MODE,
+  STATE_MODE_VALUE,
+  STATE_MODE_DOLLAR
+} detection_state_t;
 
 /** Boolean indicating whether the library is currently detecting the terminal capabilities. */
 static t3_bool detecting_terminal_capabilities = t3_true;
@@ -119,8 +128,7 @@ static void finish_detection(void) {
 static t3_bool process_position_report(int row, int column) {
   static int report_nr;
   t3_bool result = t3_false;
-  (void)row;
-
+  TRACE(TRACE_POSITION_REPORT, row, column, report_nr);
   column--;
 #define GENERATE_CODE
 #include "terminal_detection.h"
@@ -132,6 +140,18 @@ static t3_bool process_position_report(int row, int column) {
   return result;
 }
 
+/** Process a mode report triggered by a query sent during the initialization.
+    @arg mode The private mode the report is about.
+    @arg value The reported state of the mode: 0 for unknown, 1 for set, 2 for reset, 3 for
+        permanently set and 4 for permanently reset.
+*/
+static void process_mode_report(int mode, int value) {
+  TRACE(TRACE_MODE_REPORT, mode, value, 0);
+  if (mode == 2026 && (value == 1 || value == 2)) {
+    _t3_sync_output_supported = t3_true;
+  }
+}
+
 /** @internal Check if a characters is a digit, in a locale independent way. */
 #define non_locale_isdigit(_c) (strchr("0123456789", _c) != NULL)
 
@@ -148,10 +168,12 @@ static int digit_value(int c) {
 
     The position reports may generated as a response to the terminal
     initialization. They are used to determine the used character set and
-    capabilities of the terminal.
+    capabilities of the terminal. Private mode reports (@c DECRPM), generated in
+    response to queries, are passed to ::process_mode_report directly.
 */
 static t3_bool parse_position_reports(int c, t3_bool (*process)(int row, int col)) {
   static detection_state_t detection_state = STATE_INITIAL;
+  /* For mode reports, row holds the mode number and column holds the value. */
   static int row, column;
 
   switch (detection_state) {
@@ -164,12 +186,24 @@ static t3_bool parse_position_reports(int c, t3_bool (*process)(int row, int col
       break;
     case STATE_ESC_SEEN:
       if (c == '[') {
-        detection_state = STATE_ROW;
+        detection_state = STATE_CSI_SEEN;
         row = 0;
       } else {
         detection_state = STATE_INITIAL;
       }
       break;
+    case STATE_CSI_SEEN:
+      if (c == '?') {
+        detection_state = STATE_MODE;
+      } else if (non_locale_isdigit(c)) {
+        detection_state = STATE_ROW;
+        row = digit_value(c);
+      } else if (c == ';') {
+        detection_state = STATE_COLUMN;
+      } else {
+        detection_state = STATE_INITIAL;
+      }
+      break;
     case STATE_ROW:
       if (non_locale_isdigit(c)) {
         row = row * 10 + digit_value(c);
@@ -189,6 +223,30 @@ static t3_bool parse_position_reports(int c, t3_bool (*process)(int row, int col
         detection_state = STATE_INITIAL;
       }
       break;
+    case STATE_MODE:
+      if (non_locale_isdigit(c)) {
+        row = row * 10 + digit_value(c);
+      } else if (c == ';') {
+        detection_state = STATE_MODE_VALUE;
+      } else {
+        detection_state = STATE_INITIAL;
+      }
+      break;
+    case STATE_MODE_VALUE:
+      if (non_locale_isdigit(c)) {
+        column = column * 10 + digit_value(c);
+      } else if (c == '$') {
+        detection_state = STATE_MODE_DOLLAR;
+      } else {
+        detection_state = STATE_INITIAL;
+      }
+      break;
+    case STATE_MODE_DOLLAR:
+      detection_state = STATE_INITIAL;
+      if (c == 'y') {
+        process_mode_report(row, column);
+      }
+      break;
     default:
       detection_state = STATE_INITIAL;
       break;
@@ -198,7 +256,7 @@ static t3_bool parse_position_reports(int c, t3_bool (*process)(int row, int col
 
 /** Use the values from a position report to detect the terminal size. */
 static t3_bool detect_terminal_size(int row, int col) {
-  lprintf("Detected terminal size %dx%d\n", row, col);
+  TRACE(TRACE_SIZE_DETECTED, row, col, 0);
   if (row > 0 && col > 0) {
     _t3_detected_lines = row;
     _t3_detected_columns = col;
@@ -219,6 +277,7 @@ static int safe_read_char(void) {
   char c;
   while (1) {
     ssize_t retval = read(_t3_terminal_in_fd, &c, 1);
+    TRACE(TRACE_INPUT_READ, retval, retval >= 1 ? (unsigned char)c : -1, retval < 0 ? errno : 0);
     if (retval < 0 && errno == EINTR) {
       continue;
     } else if (retval >= 1) {
@@ -283,6 +342,27 @@ int t3_term_get_keychar(int msec) {
   }
 }
 
+/** @internal
+    @brief Check whether input from the terminal is available, without waiting.
+*/
+t3_bool _t3_input_pending(void) {
+  fd_set _inset;
+  struct timeval timeout;
+  int retval;
+
+  if (stored_key != INT_MIN) {
+    return t3_true;
+  }
+
+  do {
+    _inset = _t3_inset;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    retval = select(_t3_terminal_in_fd + 1, &_inset, NULL, NULL, &timeout);
+  } while (retval < 0 && errno == EINTR);
+  return retval > 0;
+}
+
 /** Push a @c char back for later retrieval with ::t3_term_get_keychar.
     @param c The @c char to push back.
     @return The @c char pushed back or ::T3_ERR_BAD_ARG.
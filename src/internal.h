@@ -23,6 +23,7 @@
 #endif
 #include <stdint.h>
 
+#include "lock.h"
 #include "window.h"
 #include "window_api.h"
 
@@ -37,6 +38,10 @@
 #define INITIAL_ALLOC 80
 
 #define _T3_BLOCK_SIZE_TO_WIDTH(x) ((int)((x & 1) + 1))
+/* The value following the block size holds the attribute index, shifted left by one. The lowest
+   bit is set if the text of the block must be filtered on output, see _t3_output_needs_filter. */
+#define _T3_BLOCK_ATTR_TO_INDEX(x) ((int)((x) >> 1))
+#define _T3_BLOCK_ATTR_FILTER 1
 
 typedef struct {
   char *data;    /* Data bytes. */
@@ -60,6 +65,9 @@ struct t3_window_t {
   t3_attr_t default_attrs; /* Default attributes to be combined with drawing attributes.
                              Mostly useful for background specification. */
   t3_bool shown;           /* Indicates whether this t3_window_t is visible. */
+  t3_bool priority;        /* Indicates whether this t3_window_t is drawn first by
+                              t3_term_update_bounded. */
+  mutex_t lock;            /* Lock for the contents, see t3_win_lock. */
   line_data_t *lines;      /* The contents of the t3_window_t. */
   t3_window_t *parent;     /* t3_window_t used for clipping. */
   t3_window_t *anchor;     /* t3_window_t for relative placment. */
@@ -72,11 +80,23 @@ struct t3_window_t {
 
   t3_window_t *head;
   t3_window_t *tail;
+
+  /* Performance counters, only updated if enabled by t3_win_set_stats_collection. */
+  t3_win_frame_stats_t frame_stats; /* Counters for the frame currently being built. */
+  t3_win_stats_t stats;             /* Counters for completed frames. */
 };
 
 T3_WINDOW_LOCAL t3_bool _t3_win_refresh_term_line(int line);
 T3_WINDOW_LOCAL int _t3_term_get_default_acs(int idx);
 T3_WINDOW_LOCAL void _t3_remove_window(t3_window_t *win);
+T3_WINDOW_LOCAL void _t3_win_mark_priority_lines(char *lines, int nr_of_lines);
+T3_WINDOW_LOCAL void _t3_win_lock_all(void);
+T3_WINDOW_LOCAL void _t3_win_unlock_all(void);
+T3_WINDOW_LOCAL void _t3_win_stats_end_frame(void);
+T3_WINDOW_LOCAL t3_window_t *_t3_win_get_cell_owner(int line, int x);
+T3_WINDOW_LOCAL void _t3_free_cell_owners(void);
+
+T3_WINDOW_LOCAL extern t3_bool _t3_win_stats_enabled;
 
 T3_WINDOW_LOCAL extern t3_window_t *_t3_terminal_window;
 
@@ -95,6 +115,8 @@ enum { _T3_MODHACK_NONE, _T3_MODHACK_LINUX };
 
 typedef enum { _T3_ACS_AUTO, _T3_ACS_ASCII, _T3_ACS_UTF8, _T3_ACS_ACS } t3_acs_override_t;
 
+typedef enum { _T3_SYNC_AUTO, _T3_SYNC_OFF, _T3_SYNC_ON } t3_sync_override_t;
+
 T3_WINDOW_LOCAL extern int _t3_term_encoding, _t3_term_combining, _t3_term_double_width;
 T3_WINDOW_LOCAL extern char _t3_current_charset[80];
 T3_WINDOW_LOCAL extern long _t3_detection_needs_finishing;
@@ -117,10 +139,26 @@ T3_WINDOW_LOCAL extern line_data_t _t3_old_data;
 T3_WINDOW_LOCAL extern t3_bool _t3_show_cursor;
 T3_WINDOW_LOCAL extern int _t3_cursor_y, _t3_cursor_x;
 T3_WINDOW_LOCAL extern t3_acs_override_t _t3_acs_override;
+T3_WINDOW_LOCAL extern t3_sync_override_t _t3_sync_override;
+T3_WINDOW_LOCAL extern t3_bool _t3_sync_output_supported;
+T3_WINDOW_LOCAL extern t3_bool _t3_nonblocking_output;
 
 T3_WINDOW_LOCAL void _t3_do_cup(int line, int col);
 T3_WINDOW_LOCAL void _t3_set_alternate_chars_defaults(void);
 T3_WINDOW_LOCAL void _t3_set_attrs(t3_attr_t new_attrs);
+T3_WINDOW_LOCAL void _t3_clear_sgr_cache(void);
+T3_WINDOW_LOCAL int64_t _t3_monotonic_usec(void);
+T3_WINDOW_LOCAL int64_t _t3_monotonic_nsec(void);
+T3_WINDOW_LOCAL void _t3_free_line_boundaries(void);
+T3_WINDOW_LOCAL void _t3_free_priority_lines(void);
+T3_WINDOW_LOCAL t3_bool _t3_input_pending(void);
+T3_WINDOW_LOCAL void _t3_emit_line(int i, const line_data_t *new_line, const line_data_t *old_line,
+                                   int terminal_width, t3_bool attribute_output);
+T3_WINDOW_LOCAL t3_bool _t3_use_sync_output(void);
+T3_WINDOW_LOCAL void _t3_begin_frame(t3_bool sync_output, t3_bool show_cursor, int cursor_y,
+                                     int cursor_x);
+T3_WINDOW_LOCAL t3_bool _t3_end_frame(t3_bool sync_output, t3_bool show_cursor, int cursor_y,
+                                      int cursor_x, int height, int width);
 
 T3_WINDOW_LOCAL extern t3_window_t *_t3_head, *_t3_tail;
 T3_WINDOW_LOCAL t3_bool _t3_win_is_shown(t3_window_t *win);
@@ -130,11 +168,28 @@ T3_WINDOW_LOCAL int _t3_map_attr(t3_attr_t attr);
 T3_WINDOW_LOCAL t3_attr_t _t3_get_attr(int idx);
 T3_WINDOW_LOCAL void _t3_init_attr_map(void);
 T3_WINDOW_LOCAL void _t3_free_attr_map(void);
+T3_WINDOW_LOCAL void _t3_win_update_filter_flags(void);
 
 #define _t3_get_value(s, size) \
   (((s)[0] & 0x80) ? _t3_get_value_int(s, size) : (uint32_t)(*(size) = 1, (s)[0]))
 T3_WINDOW_LOCAL uint32_t _t3_get_value_int(const char *s, size_t *size);
 T3_WINDOW_LOCAL size_t _t3_put_value(uint32_t c, char *dst);
+T3_WINDOW_LOCAL size_t _t3_ascii_prefix_length(const char *src, size_t n);
+T3_WINDOW_LOCAL t3_bool _t3_nfc_unstable(uint32_t c);
+
+/* State of the grapheme cluster segmentation of a string, see _t3_grapheme_continues. */
+typedef struct {
+  int prev_class; /* Grapheme break class of the previous codepoint. */
+  /* Number of regional indicators directly preceding the next codepoint. */
+  int regional_indicators;
+  /* Whether the previous codepoints are an extended pictographic character followed by zero or
+     more extending characters, and whether that was the case before the last zero-width joiner. */
+  t3_bool pictographic, pictographic_zwj;
+} grapheme_state_t;
+T3_WINDOW_LOCAL void _t3_grapheme_start(grapheme_state_t *state, uint32_t c);
+T3_WINDOW_LOCAL t3_bool _t3_grapheme_continues(grapheme_state_t *state, uint32_t c);
+T3_WINDOW_LOCAL size_t _t3_utf8_width_prefix(const char *str, size_t n, size_t max_width,
+                                             size_t *width);
 T3_WINDOW_LOCAL extern int _t3_modifier_hack;
 
 typedef enum {
@@ -148,4 +203,5 @@ T3_WINDOW_LOCAL extern volatile int _t3_detected_columns;
 T3_WINDOW_LOCAL extern t3_bool _t3_terminal_is_screen;
 
 T3_WINDOW_LOCAL void _t3_trigger_terminal_size_detection(void);
+T3_WINDOW_LOCAL void _t3_send_size_detection_query(void);
 #endif
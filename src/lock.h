@@ -0,0 +1,46 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_LOCK_H
+#define T3_LOCK_H
+
+/* Minimal locking primitives for the data shared between threads. Without thread support, these
+   compile to nothing, and the atomic operations to plain memory accesses. */
+#ifdef HAS_PTHREAD
+#include <pthread.h>
+
+typedef pthread_mutex_t mutex_t;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define MUTEX_INIT(_m) pthread_mutex_init((_m), NULL)
+#define MUTEX_DESTROY(_m) pthread_mutex_destroy(_m)
+#define MUTEX_LOCK(_m) pthread_mutex_lock(_m)
+#define MUTEX_UNLOCK(_m) pthread_mutex_unlock(_m)
+
+#define ATOMIC_LOAD(_p) __atomic_load_n((_p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(_p, _v) __atomic_store_n((_p), (_v), __ATOMIC_RELEASE)
+/* Counter updates do not order other memory accesses. */
+#define ATOMIC_ADD(_p, _v) ((void)__atomic_fetch_add((_p), (_v), __ATOMIC_RELAXED))
+#else
+typedef char mutex_t;
+#define MUTEX_INITIALIZER 0
+#define MUTEX_INIT(_m) ((void)(_m))
+#define MUTEX_DESTROY(_m) ((void)(_m))
+#define MUTEX_LOCK(_m) ((void)(_m))
+#define MUTEX_UNLOCK(_m) ((void)(_m))
+
+#define ATOMIC_LOAD(_p) (*(_p))
+#define ATOMIC_STORE(_p, _v) ((void)(*(_p) = (_v)))
+#define ATOMIC_ADD(_p, _v) ((void)(*(_p) += (_v)))
+#endif
+
+#endif
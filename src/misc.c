@@ -14,6 +14,11 @@
 #include <errno.h>
 #include <stdint.h>
 #include <string.h>
+#ifdef HAS_CLOCK_GETTIME
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
 #ifdef USE_GETTEXT
 #include <libintl.h>
 #define _(x) dgettext("LIBT3", (x))
@@ -21,6 +26,7 @@
 #define _(x) (x)
 #endif
 
+#include "internal.h"
 #include "terminal.h"
 
 /** Get the value of ::T3_WINDOW_VERSION corresponding to the actually used library.
@@ -55,3 +61,37 @@ const char *t3_window_strerror(int error) {
       return _("character-set conversion not available");
   }
 }
+
+/** @internal
+    @brief Get the current time in microseconds.
+
+    If available, a monotonic clock is used, such that changes to the system time do not affect
+    the result. The returned value is only useful for computing time differences.
+*/
+int64_t _t3_monotonic_usec(void) {
+#ifdef HAS_CLOCK_GETTIME
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+/** @internal
+    @brief Get the current time in nanoseconds.
+
+    This is the same clock as used by ::_t3_monotonic_usec, for measuring short intervals. Without
+    @c clock_gettime, the resolution is only a microsecond.
+*/
+int64_t _t3_monotonic_nsec(void) {
+#ifdef HAS_CLOCK_GETTIME
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+  return _t3_monotonic_usec() * 1000;
+#endif
+}
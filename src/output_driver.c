@@ -0,0 +1,276 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <string.h>
+
+#include "capability.h"
+#include "curses_interface.h"
+#include "frame_buffer.h"
+#include "internal.h"
+#include "output_driver.h"
+
+/** @internal
+    @brief Wrapper for strcmp which converts the return value to boolean. */
+#define streq(a, b) (strcmp((a), (b)) == 0)
+
+/** @internal
+    @brief Maximum number of bytes generated by ::xterm_set_attrs. */
+#define XTERM_MAX_SGR 64
+
+/** @internal
+    @brief Add a parameter separator while building an SGR sequence. */
+#define ADD_SEP() \
+  do {            \
+    *dst++ = sep; \
+    sep = ';';    \
+  } while (0)
+
+/** @internal
+    @brief Add a string literal to the output while building an SGR sequence. */
+#define ADD_STR(_str)                \
+  do {                               \
+    memcpy(dst, _str, strlen(_str)); \
+    dst += strlen(_str);             \
+  } while (0)
+
+/** @internal
+    @brief Maximum length of the sequence to reset all attributes used by the xterm driver. */
+#define XTERM_MAX_RESET 32
+
+/** The driver currently in use. */
+const output_driver_t *_t3_output_driver = &_t3_terminfo_driver;
+
+/** The sequence used by ::xterm_set_attrs to reset all attributes. */
+static char xterm_reset[XTERM_MAX_RESET];
+/** The length of ::xterm_reset. */
+static size_t xterm_reset_length;
+
+/** Move the cursor to the given position using CUP. */
+static void xterm_cup(int line, int col) {
+  char *start, *dst;
+
+  if ((start = dst = _t3_frame_reserve(25)) == NULL) {
+    return;
+  }
+  *dst++ = '\033';
+  *dst++ = '[';
+  dst += _t3_format_int(dst, line + 1);
+  *dst++ = ';';
+  dst += _t3_format_int(dst, col + 1);
+  *dst++ = 'H';
+  _t3_frame_commit(dst - start);
+}
+
+/** Move the cursor to the given column using CHA. */
+static void xterm_hpa(int col) {
+  char *start, *dst;
+
+  if ((start = dst = _t3_frame_reserve(14)) == NULL) {
+    return;
+  }
+  *dst++ = '\033';
+  *dst++ = '[';
+  dst += _t3_format_int(dst, col + 1);
+  *dst++ = 'G';
+  _t3_frame_commit(dst - start);
+}
+
+/** Add the SGR parameter for a foreground or background color.
+    @param dst The location to store the parameter.
+    @param color_nr The color number, -1 or 256 for the default color.
+    @param base The character for the basic colors ('3' for foreground, '4' for background).
+    @return The number of bytes written.
+*/
+static size_t add_color(char *dst, int color_nr, char base) {
+  char *start = dst;
+
+  if (color_nr < 8 || color_nr == 256) {
+    *dst++ = base;
+    *dst++ = '0' + (color_nr >= 0 && color_nr < 8 ? color_nr : 9);
+  } else if (color_nr < 16) {
+    if (base == '3') {
+      *dst++ = '9';
+    } else {
+      *dst++ = '1';
+      *dst++ = '0';
+    }
+    *dst++ = '0' + color_nr - 8;
+  } else {
+    *dst++ = base;
+    ADD_STR("8;5;");
+    dst += _t3_format_int(dst, color_nr);
+  }
+  return dst - start;
+}
+
+/** Add the sequences to switch from one set of attributes to another.
+    @param dst The location to store the sequences, which must have room for ::XTERM_MAX_SGR bytes.
+    @param old_attrs The attributes currently in effect.
+    @param new_attrs The attributes to switch to, which must not be @c 0.
+    @return The end of the added sequences.
+
+    The ACS attribute is switched using the xterm character set designation if the terminal does
+    not use the ANSI sequences for it. The parameters are added in the same order as the terminfo
+    driver uses.
+*/
+static char *add_attrs(char *dst, t3_attr_t old_attrs, t3_attr_t new_attrs) {
+  t3_attr_t changed_attrs;
+  char sep = '[';
+
+  if (!(_t3_ansi_attrs & T3_ATTR_ACS) && ((old_attrs ^ new_attrs) & T3_ATTR_ACS)) {
+    ADD_STR(new_attrs & T3_ATTR_ACS ? _t3_smacs : _t3_rmacs);
+  }
+
+  changed_attrs = (new_attrs ^ old_attrs) & _t3_ansi_attrs;
+  if (changed_attrs == 0) {
+    return dst;
+  }
+
+  *dst++ = '\033';
+
+  if (changed_attrs & T3_ATTR_UNDERLINE) {
+    ADD_SEP();
+    ADD_STR(new_attrs & T3_ATTR_UNDERLINE ? "4" : "24");
+  }
+
+  if (changed_attrs & (T3_ATTR_BOLD | T3_ATTR_DIM)) {
+    ADD_SEP();
+    ADD_STR(new_attrs & T3_ATTR_BOLD ? "1" : (new_attrs & T3_ATTR_DIM ? "2" : "22"));
+  }
+
+  if (changed_attrs & T3_ATTR_REVERSE) {
+    ADD_SEP();
+    ADD_STR(new_attrs & T3_ATTR_REVERSE ? "7" : "27");
+  }
+
+  if (changed_attrs & T3_ATTR_BLINK) {
+    ADD_SEP();
+    ADD_STR(new_attrs & T3_ATTR_BLINK ? "5" : "25");
+  }
+
+  if (changed_attrs & T3_ATTR_ACS) {
+    ADD_SEP();
+    ADD_STR(new_attrs & T3_ATTR_ACS ? "11" : "10");
+  }
+
+  if (changed_attrs & T3_ATTR_FG_MASK) {
+    ADD_SEP();
+    dst += add_color(dst, ((new_attrs & T3_ATTR_FG_MASK) >> T3_ATTR_COLOR_SHIFT) - 1, '3');
+  }
+
+  if (changed_attrs & T3_ATTR_BG_MASK) {
+    ADD_SEP();
+    dst += add_color(dst, ((new_attrs & T3_ATTR_BG_MASK) >> (T3_ATTR_COLOR_SHIFT + 9)) - 1, '4');
+  }
+  *dst++ = 'm';
+  return dst;
+}
+
+/** Set the drawing attributes using ANSI SGR sequences.
+
+    This produces exactly the same output as the terminfo driver, but without the string
+    manipulation. All attributes are reset using ::xterm_reset, which is the string the terminfo
+    driver would use. Like the terminfo driver, this switches attributes by resetting all
+    attributes first, if that results in a shorter sequence.
+*/
+static void xterm_set_attrs(t3_attr_t new_attrs) {
+  char *start, *end, *reset_start, *reset_end;
+
+  if ((start = _t3_frame_reserve(2 * XTERM_MAX_SGR + 2 * xterm_reset_length)) == NULL) {
+    return;
+  }
+
+  if (new_attrs == 0) {
+    if (_t3_attrs == 0) {
+      return;
+    }
+    memcpy(start, xterm_reset, xterm_reset_length);
+    _t3_frame_commit(xterm_reset_length);
+    _t3_attrs = 0;
+    return;
+  }
+
+  end = add_attrs(start, _t3_attrs, new_attrs);
+  if (_t3_attrs != 0) {
+    reset_start = end;
+    memcpy(reset_start, xterm_reset, xterm_reset_length);
+    reset_end = add_attrs(reset_start + xterm_reset_length, 0, new_attrs);
+    if (reset_end - reset_start < end - start) {
+      memmove(start, reset_start, reset_end - reset_start);
+      end = start + (reset_end - reset_start);
+    }
+  }
+  _t3_frame_commit(end - start);
+  _t3_attrs = new_attrs;
+}
+
+/** Clear to the end of the line using EL. */
+static void xterm_el(void) { _t3_frame_write("\033[K", 3); }
+
+/** @internal Driver for xterm and compatible terminals. */
+const output_driver_t _t3_xterm_driver = {"xterm", xterm_cup, xterm_hpa, xterm_set_attrs,
+                                          xterm_el};
+
+/** Check whether an attribute is either not available, or set through ANSI sequences. */
+static t3_bool ansi_or_absent(const char *str, t3_attr_t attr) {
+  return str == NULL || (_t3_ansi_attrs & attr);
+}
+
+/** @internal
+    @brief Select the output driver to use for the current terminal.
+
+    The xterm driver is selected only if the terminfo description of the terminal uses exactly the
+    control sequences that the xterm driver generates. Otherwise the terminfo driver is used.
+*/
+const output_driver_t *_t3_select_output_driver(void) {
+  const char *reset;
+
+  if (_t3_cup == NULL || !streq(_t3_cup, "\033[%i%p1%d;%p2%dH")) {
+    return &_t3_terminfo_driver;
+  }
+  if (_t3_hpa != NULL && !streq(_t3_hpa, "\033[%i%p1%dG")) {
+    return &_t3_terminfo_driver;
+  }
+  if (_t3_el == NULL || !streq(_t3_el, "\033[K")) {
+    return &_t3_terminfo_driver;
+  }
+  if ((_t3_ansi_attrs & (T3_ATTR_FG_MASK | T3_ATTR_BG_MASK)) !=
+      (T3_ATTR_FG_MASK | T3_ATTR_BG_MASK)) {
+    return &_t3_terminfo_driver;
+  }
+  if (!ansi_or_absent(_t3_smul, T3_ATTR_UNDERLINE) || !ansi_or_absent(_t3_bold, T3_ATTR_BOLD) ||
+      !ansi_or_absent(_t3_rev, T3_ATTR_REVERSE) || !ansi_or_absent(_t3_blink, T3_ATTR_BLINK) ||
+      !ansi_or_absent(_t3_dim, T3_ATTR_DIM)) {
+    return &_t3_terminfo_driver;
+  }
+  if (!ansi_or_absent(_t3_smacs, T3_ATTR_ACS) &&
+      (!streq(_t3_smacs, "\033(0") || _t3_rmacs == NULL || !streq(_t3_rmacs, "\033(B"))) {
+    return &_t3_terminfo_driver;
+  }
+  /* Attributes not set through ANSI sequences, which can only be removed by resetting all
+     attributes, require the logic of the terminfo driver. */
+  if (_t3_reset_required_mask & ~_t3_ansi_attrs) {
+    return &_t3_terminfo_driver;
+  }
+
+  /* Use the same string to reset the attributes as the terminfo driver. */
+  reset = _t3_sgr != NULL ? _t3_tparm(_t3_sgr, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0) : _t3_sgr0;
+  if (reset == NULL || strlen(reset) >= XTERM_MAX_RESET || strstr(reset, "$<") != NULL) {
+    return &_t3_terminfo_driver;
+  }
+  xterm_reset_length = strlen(reset);
+  memcpy(xterm_reset, reset, xterm_reset_length);
+  return &_t3_xterm_driver;
+}
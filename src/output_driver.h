@@ -0,0 +1,44 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_OUTPUT_DRIVER_H
+#define T3_OUTPUT_DRIVER_H
+
+#include "terminal.h"
+#include "window_api.h"
+
+/* Set of functions used to generate the control sequences for the most
+   frequently used operations during a terminal update. The terminfo driver
+   uses the strings from the terminfo database and works for all terminals.
+   Other drivers may generate the control sequences directly, if it has been
+   established that the terminal uses the expected sequences. */
+typedef struct {
+  const char *name;
+  /* Move the cursor to the given position. */
+  void (*cup)(int line, int col);
+  /* Move the cursor to the given column in the current line. Only called if hpa is available. */
+  void (*hpa)(int col);
+  /* Switch to the given attributes, and update _t3_attrs accordingly. Only called if the
+     attributes differ from _t3_attrs. */
+  void (*set_attrs)(t3_attr_t new_attrs);
+  /* Clear to the end of the line. Only called if el is available. */
+  void (*el)(void);
+} output_driver_t;
+
+T3_WINDOW_LOCAL extern const output_driver_t _t3_terminfo_driver;
+T3_WINDOW_LOCAL extern const output_driver_t _t3_xterm_driver;
+T3_WINDOW_LOCAL extern const output_driver_t *_t3_output_driver;
+
+T3_WINDOW_LOCAL const output_driver_t *_t3_select_output_driver(void);
+
+#endif
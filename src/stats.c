@@ -0,0 +1,82 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <string.h>
+
+#include "internal.h"
+#include "stats.h"
+
+/* The counters are treated as an array of unsigned long when a frame ends. */
+#define NR_OF_COUNTERS (sizeof(t3_term_frame_stats_t) / sizeof(unsigned long))
+
+/** @internal Counters for the frame currently being built. */
+t3_term_frame_stats_t _t3_frame_stats;
+
+static t3_term_stats_t stats; /**< Counters of completed frames. */
+
+/** @internal
+    @brief Add the counters of the current frame to the statistics, and start a new frame.
+    @param start The time at which the update for the frame started, from ::_t3_monotonic_usec.
+*/
+void _t3_stats_end_frame(int64_t start) {
+  unsigned long *current = (unsigned long *)&_t3_frame_stats;
+  unsigned long *last = (unsigned long *)&stats.last_frame;
+  unsigned long *totals = (unsigned long *)&stats.totals;
+  int64_t latency = _t3_monotonic_usec() - start;
+  size_t i;
+  int bucket;
+
+  for (i = 0; i < NR_OF_COUNTERS; i++) {
+    /* Subtract rather than clear the value, to keep counts added by other threads in the mean
+       time. */
+    last[i] = ATOMIC_LOAD(&current[i]);
+    ATOMIC_ADD(&current[i], 0UL - last[i]);
+    totals[i] += last[i];
+  }
+  stats.frames++;
+
+  for (bucket = 0; bucket < T3_TERM_STATS_HISTOGRAM_SIZE - 1 && latency >= ((int64_t)2 << bucket);
+       bucket++) {
+  }
+  stats.update_latency[bucket]++;
+  if (latency > (int64_t)stats.max_update_latency) {
+    stats.max_update_latency = latency;
+  }
+}
+
+/** Get the performance counters of the library.
+    @param result The location to store the counters.
+    @param version The version of the library the caller was compiled against.
+
+    This function should not be called directly, but through the ::t3_term_get_stats macro. The
+    counters are cheap to maintain, so they are always enabled. They can be reset by calling
+    ::t3_term_reset_stats.
+*/
+void t3_term_get_stats_internal(t3_term_stats_t *result, int version) {
+  (void)version;
+  *result = stats;
+  result->attr_map_size = _t3_attr_map_size();
+}
+
+/** Reset all performance counters to zero. */
+void t3_term_reset_stats(void) {
+  unsigned long *current = (unsigned long *)&_t3_frame_stats;
+  size_t i;
+
+  for (i = 0; i < NR_OF_COUNTERS; i++) {
+    ATOMIC_ADD(&current[i], 0UL - ATOMIC_LOAD(&current[i]));
+  }
+  memset(&stats, 0, sizeof(stats));
+}
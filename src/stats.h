@@ -0,0 +1,32 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_STATS_H
+#define T3_STATS_H
+
+#include <stdint.h>
+
+#include "lock.h"
+#include "terminal.h"
+#include "window_api.h"
+
+/* Counters may be updated from painting threads and the writer thread, so they are updated
+   atomically. Relaxed atomic additions are cheap enough to leave the counters enabled always. */
+#define STATS_ADD(_field, _n) ATOMIC_ADD(&_t3_frame_stats._field, (unsigned long)(_n))
+
+T3_WINDOW_LOCAL extern t3_term_frame_stats_t _t3_frame_stats;
+
+T3_WINDOW_LOCAL void _t3_stats_end_frame(int64_t start);
+T3_WINDOW_LOCAL size_t _t3_attr_map_size(void);
+
+#endif
@@ -29,9 +29,16 @@
 #include <assert.h>
 #include <limits.h>
 
+#include "async_output.h"
+#include "capability.h"
 #include "convert_output.h"
+#include "debug_repaint.h"
+#include "frame_buffer.h"
 #include "internal.h"
 #include "log.h"
+#include "output_driver.h"
+#include "stats.h"
+#include "trace.h"
 #include "utf8.h"
 #include "window.h"
 /* The curses header file defines too many symbols that get in the way of our
@@ -74,6 +81,16 @@ TODO list:
     (b) = save;          \
   } while (0)
 
+/** @internal
+    @brief Sequence to start synchronized output (private mode 2026). */
+#define SYNC_BEGIN "\033[?2026h"
+/** @internal
+    @brief Length of ::SYNC_BEGIN. */
+#define SYNC_BEGIN_LENGTH (sizeof(SYNC_BEGIN) - 1)
+/** @internal
+    @brief Sequence to end synchronized output (private mode 2026). */
+#define SYNC_END "\033[?2026l"
+
 char *_t3_cup,  /**< @internal Terminal control string: position cursor. */
     *_t3_sc,    /**< @internal Terminal control string: save cursor position. */
     *_t3_rc,    /**< @internal Terminal control string: restore cursor position. */
@@ -115,6 +132,37 @@ t3_window_t *_t3_terminal_window; /**< @internal t3_window_t struct representing
 line_data_t _t3_old_data; /**< @internal line_data_t struct used in terminal update to save previous
                              line state. */
 
+/** Position of the output for a line in the frame buffer.
+
+    These are recorded while creating a frame in non-blocking mode, such that the part of the frame
+    that the terminal did not accept yet can be abandoned at a line boundary. */
+typedef struct {
+  int line;        /**< The line for which output starts, or -1 for the end of the frame. */
+  size_t offset;   /**< Offset in the frame buffer at which the output for the line starts. */
+  t3_attr_t attrs; /**< Terminal attributes in effect at the start of the line. */
+} line_boundary_t;
+
+static line_boundary_t *line_boundaries; /**< Line boundaries of the last frame. */
+static int line_boundaries_allocated,    /**< Number of elements allocated in line_boundaries. */
+    nr_of_line_boundaries; /**< Number of boundaries recorded in line_boundaries. */
+static t3_bool frame_sync_output; /**< Boolean indicating whether the last frame used synchronized
+                                     output. */
+static size_t sync_begin_offset, /**< Offset of the start of synchronized output in the frame. */
+    frame_content_offset; /**< Offset in the frame buffer at which the lines of the frame start. */
+
+static int64_t min_frame_interval, /**< Minimum time between two frames in microseconds, or 0. */
+    last_frame_time;               /**< Time at which the last frame was emitted. */
+static t3_bool frame_pending; /**< Boolean indicating whether an update was deferred or
+                                 incomplete. */
+static t3_bool typeahead_check; /**< Boolean indicating whether updates stop on pending input. */
+
+static int64_t update_deadline; /**< Time at which a bounded update should stop, or 0. */
+static size_t update_byte_limit; /**< Frame buffer length at which a bounded update should stop, or
+                                    0. */
+static int resume_line; /**< Line at which the last bounded update stopped. */
+static char *priority_lines; /**< Per line flag indicating whether it is drawn first, or NULL. */
+static int priority_lines_allocated; /**< Number of elements allocated in priority_lines. */
+
 int _t3_lines,           /**< @internal Size of terminal (lines). */
     _t3_columns;         /**< @internal Size of terminal (columns). */
 int _t3_cursor_y,        /**< @internal Cursor position (y coordinate). */
@@ -137,6 +185,31 @@ t3_attr_t _t3_attrs = 0, /**< @internal Last used set of attributes. */
 /** Callback for T3_ATTR_USER. */
 static t3_attr_user_callback_t user_callback = NULL;
 
+/** @internal
+    @brief The number of entries in the attribute transition cache. Must be a power of two. */
+#define SGR_CACHE_SIZE 256
+/** @internal
+    @brief The maximum length of a control sequence stored in the attribute transition cache. */
+#define SGR_CACHE_MAX_LENGTH 46
+/** @internal
+    @brief Compute the index in the attribute transition cache for a transition. */
+#define SGR_CACHE_HASH(_from, _to)                                                     \
+  (((((unsigned int)(_from)*0x9e3779b1u) ^ ((unsigned int)(_to)*0x85ebca6bu)) >> 24) & \
+   (SGR_CACHE_SIZE - 1))
+
+/** Entry in the attribute transition cache. */
+typedef struct {
+  t3_attr_t from;                  /**< Attributes before the transition. */
+  t3_attr_t to;                    /**< Requested attributes. */
+  t3_attr_t result;                /**< Value of ::_t3_attrs after the transition. */
+  unsigned char used;              /**< Boolean indicating whether this entry is valid. */
+  unsigned char length;            /**< Length of the control sequence in @c data. */
+  char data[SGR_CACHE_MAX_LENGTH]; /**< Control sequence for the transition. */
+} sgr_cache_entry_t;
+
+/** Cache of control sequences for transitions between attribute sets. */
+static sgr_cache_entry_t sgr_cache[SGR_CACHE_SIZE];
+
 /** @internal Alternate character set conversion table from TERM_* values to terminal ACS
  * characters. */
 char _t3_alternate_chars[256];
@@ -148,7 +221,7 @@ const char *_t3_default_alternate_chars[256];
 /** @internal File descriptor of the terminal for input. */
 int _t3_terminal_in_fd;
 /** @internal File descriptor of the terminal for output. */
-int _t3_terminal_out_fd;
+int _t3_terminal_out_fd = -1;
 
 /** @internal Boolean indicating whether the terminal capbilities detection requires finishing.
 
@@ -178,6 +251,14 @@ char _t3_current_charset[80];
 /** @internal Variable indicating if and if so how the ACS should be overriden. */
 t3_acs_override_t _t3_acs_override;
 
+/** @internal Variable indicating whether synchronized output should be used regardless of the
+    detected terminal support. */
+t3_sync_override_t _t3_sync_override;
+
+/** @internal Boolean indicating whether the terminal reported support for synchronized output
+    (private mode 2026). */
+t3_bool _t3_sync_output_supported;
+
 /** @internal Variable indicating what hack to obtain modifiers should be used, if any. */
 int _t3_modifier_hack;
 
@@ -223,21 +304,21 @@ static const char *get_default_acs(int idx) {
   return retval != NULL ? retval : acs_ascii_defaults[idx];
 }
 
-/** Move cursor to screen position.
+/** Move cursor to screen position using the terminfo strings.
     @param line The screen line to move the cursor to.
     @param col The screen column to move the cursor to.
 
         This function uses the @c _t3_cup terminfo string if available, and emulates
     it through other means if necessary.
 */
-void _t3_do_cup(int line, int col) {
+static void terminfo_cup(int line, int col) {
   if (_t3_cup != NULL) {
-    _t3_putp(_t3_tparm(_t3_cup, 2, line, col));
+    _t3_putp_cap(&_t3_cup_cap, line, col);
     return;
   }
   if (_t3_vpa != NULL) {
-    _t3_putp(_t3_tparm(_t3_vpa, 1, line));
-    _t3_putp(_t3_tparm(_t3_hpa, 1, col));
+    _t3_putp_cap(&_t3_vpa_cap, line, 0);
+    _t3_putp_cap(&_t3_hpa_cap, col, 0);
     return;
   }
   if (_t3_home != NULL) {
@@ -246,7 +327,7 @@ void _t3_do_cup(int line, int col) {
     _t3_putp(_t3_home);
     if (line > 0) {
       if (_t3_cud != NULL) {
-        _t3_putp(_t3_tparm(_t3_cud, 1, line));
+        _t3_putp_cap(&_t3_cud_cap, line, 0);
       } else {
         for (i = 0; i < line; i++) {
           _t3_putp(_t3_cud1);
@@ -255,7 +336,7 @@ void _t3_do_cup(int line, int col) {
     }
     if (col > 0) {
       if (_t3_cuf != NULL) {
-        _t3_putp(_t3_tparm(_t3_cuf, 1, col));
+        _t3_putp_cap(&_t3_cuf_cap, col, 0);
       } else {
         for (i = 0; i < col; i++) {
           _t3_putp(_t3_cuf1);
@@ -265,6 +346,24 @@ void _t3_do_cup(int line, int col) {
   }
 }
 
+/** Move cursor to column @p col using the @c hpa terminfo string. */
+static void terminfo_hpa(int col) { _t3_putp_cap(&_t3_hpa_cap, col, 0); }
+
+/** Clear to the end of the line using the @c el terminfo string. */
+static void terminfo_el(void) { _t3_putp(_t3_el); }
+
+/** @internal
+    @brief Move cursor to screen position.
+    @param line The screen line to move the cursor to.
+    @param col The screen column to move the cursor to.
+*/
+void _t3_do_cup(int line, int col) {
+  size_t frame_length = _t3_frame_length();
+  _t3_output_driver->cup(line, col);
+  STATS_ADD(cup_calls, 1);
+  STATS_ADD(cursor_bytes, _t3_frame_length() - frame_length);
+}
+
 /** Trigger the detection of the terminal size. */
 void _t3_trigger_terminal_size_detection(void) {
   /* Don't attempt to detect the size of the terminal if it would result in
@@ -273,6 +372,16 @@ void _t3_trigger_terminal_size_detection(void) {
     return;
   }
   _t3_detect_terminal_size = SIZE_DETECTION_TRIGGERED;
+  if (_t3_async_output_active()) {
+    _t3_async_request(ASYNC_DETECT_SIZE);
+    return;
+  }
+  _t3_send_size_detection_query();
+}
+
+/** @internal
+    @brief Send the query used for detecting the terminal size. */
+void _t3_send_size_detection_query(void) {
   /* Attempt to put the cursor down in the bottom corner by moving it to coordinates
      which are pretty much guaranteed to be off screen, keeping in mind the limitations
      that some implementations may impose. */
@@ -493,23 +602,16 @@ static void set_attrs_non_ansi(t3_attr_t new_attrs) {
   }
 }
 
-/** @internal
-    @brief Set terminal drawing attributes.
+/** Set terminal drawing attributes, without consulting the transition cache.
     @param new_attrs The new attributes that should be used for subsequent character display.
 
     The state of ::_t3_attrs is updated to reflect the new state.
 */
-void _t3_set_attrs(t3_attr_t new_attrs) {
+static void set_attrs_uncached(t3_attr_t new_attrs) {
   char mode_string[30]; /* Max is (if I counted correctly) 24. Use 30 for if I miscounted. */
   t3_attr_t changed_attrs;
   const char *sep = "[";
 
-  /* Flush any characters accumulated in the output buffer before switching attributes. */
-  _t3_output_buffer_print();
-
-  /* Just in case the caller forgot */
-  new_attrs &= ~T3_ATTR_FALLBACK_ACS;
-
   if (new_attrs == 0) {
     if (_t3_attrs == 0) {
       return;
@@ -601,6 +703,109 @@ void _t3_set_attrs(t3_attr_t new_attrs) {
   _t3_attrs = new_attrs;
 }
 
+/** Reset all terminal drawing attributes, and then set the requested attributes.
+    @param new_attrs The new attributes that should be used for subsequent character display.
+
+    Only to be used if either @c sgr or @c sgr0 is available.
+*/
+static void set_attrs_reset(t3_attr_t new_attrs) {
+  if (_t3_sgr != NULL) {
+    _t3_putp(_t3_tparm(_t3_sgr, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+  } else {
+    _t3_putp(_t3_sgr0);
+  }
+  _t3_attrs = 0;
+  set_attrs_uncached(new_attrs);
+}
+
+/** @internal
+    @brief Forget all cached attribute transitions.
+
+    Must be called whenever the control sequences used by ::set_attrs_uncached change.
+*/
+void _t3_clear_sgr_cache(void) { memset(sgr_cache, 0, sizeof(sgr_cache)); }
+
+/** Set terminal drawing attributes using the terminfo strings.
+    @param new_attrs The new attributes that should be used for subsequent character display.
+
+    The state of ::_t3_attrs is updated to reflect the new state.
+
+    The control sequences required to go from one set of attributes to another are remembered in a
+    small cache, such that frequently used transitions only require a table lookup. When the
+    transition is first computed, both the incremental change and a complete reset followed by
+    setting the new attributes are tried, and the shorter of the two is used.
+*/
+static void terminfo_set_attrs(t3_attr_t new_attrs) {
+  sgr_cache_entry_t *entry;
+  t3_attr_t old_attrs;
+  size_t start, length;
+
+  old_attrs = _t3_attrs;
+  entry = &sgr_cache[SGR_CACHE_HASH(old_attrs, new_attrs)];
+  if (entry->used && entry->from == old_attrs && entry->to == new_attrs) {
+    _t3_frame_write(entry->data, entry->length);
+    _t3_attrs = entry->result;
+    return;
+  }
+
+  start = _t3_frame_length();
+  set_attrs_uncached(new_attrs);
+  length = _t3_frame_length() - start;
+
+  if (new_attrs != 0 && old_attrs != 0 && (_t3_sgr != NULL || _t3_sgr0 != NULL)) {
+    t3_attr_t incremental_result = _t3_attrs;
+    size_t reset_length;
+
+    _t3_attrs = old_attrs;
+    set_attrs_reset(new_attrs);
+    reset_length = _t3_frame_length() - start - length;
+    if (reset_length < length) {
+      memmove(_t3_frame_get(start), _t3_frame_get(start + length), reset_length);
+      length = reset_length;
+    } else {
+      _t3_attrs = incremental_result;
+    }
+    _t3_frame_truncate(start + length);
+  }
+
+  if (length <= SGR_CACHE_MAX_LENGTH) {
+    entry->used = t3_true;
+    entry->from = old_attrs;
+    entry->to = new_attrs;
+    entry->result = _t3_attrs;
+    entry->length = (unsigned char)length;
+    memcpy(entry->data, _t3_frame_get(start), length);
+  }
+}
+
+/** @internal Driver using the terminfo strings, which works for all terminals. */
+const output_driver_t _t3_terminfo_driver = {"terminfo", terminfo_cup, terminfo_hpa,
+                                             terminfo_set_attrs, terminfo_el};
+
+/** @internal
+    @brief Set terminal drawing attributes.
+    @param new_attrs The new attributes that should be used for subsequent character display.
+
+    The state of ::_t3_attrs is updated to reflect the new state.
+*/
+void _t3_set_attrs(t3_attr_t new_attrs) {
+  size_t frame_length;
+
+  /* Flush any characters accumulated in the output buffer before switching attributes. */
+  _t3_output_buffer_print();
+  STATS_ADD(set_attrs_calls, 1);
+
+  /* Just in case the caller forgot */
+  new_attrs &= ~T3_ATTR_FALLBACK_ACS;
+
+  if (new_attrs == _t3_attrs) {
+    return;
+  }
+  frame_length = _t3_frame_length();
+  _t3_output_driver->set_attrs(new_attrs);
+  STATS_ADD(sgr_bytes, _t3_frame_length() - frame_length);
+}
+
 /** Set terminal drawing attributes.
     @param new_attrs The new attributes that should be used for subsequent character display.
 */
@@ -608,11 +813,90 @@ void t3_term_set_attrs(t3_attr_t new_attrs) { _t3_set_attrs(new_attrs); }
 
 /** Set callback for drawing characters with ::T3_ATTR_USER attribute.
     @param callback The function to call for drawing.
+
+    In asynchronous output mode the callback is called on the writer thread. See
+    ::t3_term_set_async_output.
 */
 void t3_term_set_user_callback(t3_attr_user_callback_t callback) { user_callback = callback; }
 
+/** Write the frame buffer to the terminal, blocking only if not in non-blocking mode. */
+static void flush_output(void) {
+  if (_t3_nonblocking_output) {
+    _t3_frame_try_flush();
+  } else {
+    _t3_frame_flush();
+  }
+}
+
+/** Stop sending the part of the last frame that the terminal has not accepted yet.
+
+    The frame is truncated at the start of the first line that was not sent completely. All lines
+    drawn after that point are marked as having unknown contents, such that they will be redrawn
+    completely by the next update.
+*/
+static void abandon_stale_output(void) {
+  size_t written = _t3_frame_written_length();
+  int i;
+
+  for (i = 0; i < nr_of_line_boundaries && line_boundaries[i].offset < written; i++) {
+  }
+  if (i == nr_of_line_boundaries) {
+    /* Only the cursor positioning at the end of the frame is still pending. */
+    return;
+  }
+
+  _t3_frame_truncate(line_boundaries[i].offset);
+  _t3_attrs = line_boundaries[i].attrs;
+  for (; i < nr_of_line_boundaries; i++) {
+    int line = line_boundaries[i].line;
+    if (line < 0 || line >= _t3_terminal_window->height) {
+      continue;
+    }
+    _t3_terminal_window->lines[line].start = 0;
+    _t3_terminal_window->lines[line].width = _t3_terminal_window->width;
+    _t3_terminal_window->lines[line].length = 0;
+  }
+  /* The cursor is always hidden while drawing the lines, so the part of the frame that was sent
+     leaves it hidden. */
+  if (_t3_civis != NULL) {
+    _t3_show_cursor = t3_false;
+  }
+  if (frame_sync_output) {
+    _t3_frame_puts(SYNC_END);
+  }
+  nr_of_line_boundaries = 0;
+  _t3_frame_compact();
+}
+
+/** Record the start of the output for a line in the frame buffer.
+    @param line The line for which output starts, or -1 for the end of the frame.
+*/
+static void record_line_boundary(int line) {
+  if (nr_of_line_boundaries >= line_boundaries_allocated) {
+    return;
+  }
+  line_boundaries[nr_of_line_boundaries].line = line;
+  line_boundaries[nr_of_line_boundaries].offset = _t3_frame_length();
+  line_boundaries[nr_of_line_boundaries].attrs = _t3_attrs;
+  nr_of_line_boundaries++;
+}
+
+/** @internal
+    @brief Free the memory used for recording line boundaries in non-blocking mode. */
+void _t3_free_line_boundaries(void) {
+  free(line_boundaries);
+  line_boundaries = NULL;
+  line_boundaries_allocated = 0;
+  nr_of_line_boundaries = 0;
+}
+
 /** Update the cursor, not drawing anything. */
 void t3_term_update_cursor(void) {
+  /* The writer thread owns the cursor state, so send it a new frame instead. */
+  if (_t3_async_output_active()) {
+    t3_term_update();
+    return;
+  }
   /* Only move the cursor if it is to be shown after the update. */
   if (new_show_cursor != _t3_show_cursor) {
     _t3_show_cursor = new_show_cursor;
@@ -631,261 +915,705 @@ void t3_term_update_cursor(void) {
       _t3_cursor_x = new_cursor_x;
     }
   }
-  fflush(_t3_putp_file);
+  flush_output();
 }
 
-/** Update the terminal, drawing all changes since last refresh.
-
-    After changing window contents, this function should be called to make those
-    changes visible on the terminal. The refresh is not done automatically to allow
-    programs to bunch many separate updates. Generally this is called right before
-    ::t3_term_get_keychar.
+/** Attribute the output generated since the previous call to the window that owns the cells.
+    @param owner The current owner, which is updated to @p next_owner.
+    @param mark The frame buffer offset up to which output has been attributed.
+    @param next_owner The owner of the cells for which output is generated next.
 */
-void t3_term_update(void) {
-  int i;
-
-  if (_t3_detection_needs_finishing) {
-    _t3_init_output_converter(_t3_current_charset);
-    _t3_set_alternate_chars_defaults();
-    t3_term_redraw();
-    _t3_detection_needs_finishing = t3_false;
+static void attribute_output(t3_window_t **owner, size_t *mark, t3_window_t *next_owner) {
+  if (next_owner == *owner) {
+    return;
+  }
+  /* Make sure all text for the previous owner is in the frame buffer. */
+  _t3_output_buffer_print();
+  if (*owner != NULL) {
+    (*owner)->frame_stats.output_bytes += _t3_frame_length() - *mark;
   }
+  *mark = _t3_frame_length();
+  *owner = next_owner;
+}
 
-  if (_t3_civis != NULL) {
-    if (new_show_cursor != _t3_show_cursor) {
-      /* If the cursor should now be invisible, hide it before drawing. If the
-         cursor should now be visible, leave it invisible until after drawing. */
-      if (!new_show_cursor) {
-        _t3_putp(_t3_civis);
-      }
-    } else if (_t3_show_cursor) {
-      if (new_cursor_y == _t3_cursor_y && new_cursor_x == _t3_cursor_x) {
-        _t3_putp(_t3_sc);
-      }
-      _t3_putp(_t3_civis);
+/** Skip the blocks of @p old_line that end at or before column @p width.
+    @param old_line The current contents of the line on the terminal.
+    @param old_idx The offset of the current block in @p old_line, which is updated.
+    @param old_width The column at which the current block starts, which is updated.
+*/
+static void skip_old_blocks(const line_data_t *old_line, int *old_idx, int *old_width, int width) {
+  uint32_t old_block_size;
+  size_t old_block_size_bytes;
+
+  while (*old_idx < old_line->length) {
+    old_block_size = _t3_get_value(old_line->data + *old_idx, &old_block_size_bytes);
+    if (*old_width + _T3_BLOCK_SIZE_TO_WIDTH(old_block_size) > width) {
+      break;
     }
+    *old_width += _T3_BLOCK_SIZE_TO_WIDTH(old_block_size);
+    *old_idx += (old_block_size >> 1) + old_block_size_bytes;
   }
+}
 
-  for (i = 0; i < _t3_lines; i++) {
-    int old_idx = 0, new_idx = 0, width, old_width, last_width = -1;
-    uint32_t old_block_size, new_block_size;
-    size_t old_block_size_bytes, new_block_size_bytes;
+/** @internal
+    @brief Send the changes required to update a terminal line to the terminal.
+    @param i The line to update.
+    @param new_line The new contents of the line.
+    @param old_line The current contents of the line on the terminal.
+    @param terminal_width The width of the terminal.
+    @param just_composited Boolean indicating whether @p new_line was just composited by
+        ::_t3_win_refresh_term_line in the calling thread. Only then can the output be attributed
+        to the windows owning the cells, and be tinted in the repaint debug mode.
+
+    Only the differences between @p old_line and @p new_line are sent to the terminal.
+*/
+void _t3_emit_line(int i, const line_data_t *new_line, const line_data_t *old_line,
+                   int terminal_width, t3_bool just_composited) {
+  int old_idx = 0, new_idx = 0, width, old_width, last_width = -1, blocks_compared = 0;
+  uint32_t old_block_size, new_block_size;
+  size_t old_block_size_bytes, new_block_size_bytes, frame_length = _t3_frame_length();
+  t3_window_t *owner = NULL;
+  size_t owner_mark = frame_length;
+  t3_bool attribute_output_bytes = just_composited && _t3_win_stats_enabled;
+  t3_bool debug_repaint = just_composited && _t3_debug_repaint != DEBUG_REPAINT_OFF &&
+                          _t3_repaint_begin_line(i, new_line, old_line);
+
+  width = new_line->start;
+  old_width = old_line->start;
+
+  if (width > old_width && old_line->width > 0) {
+    int spaces;
+    _t3_do_cup(i, old_line->start);
+    _t3_set_attrs(0);
+
+    if (old_line->start + old_line->width < width) {
+      spaces = old_line->width;
+      old_idx = old_line->length;
+      old_width = old_line->start + old_line->width;
+      last_width = old_width;
+    } else {
+      spaces = new_line->start - old_line->start;
+      skip_old_blocks(old_line, &old_idx, &old_width, width);
+      last_width = width;
+    }
 
-    SWAP_LINES(_t3_old_data, _t3_terminal_window->lines[i]);
-    _t3_win_refresh_term_line(i);
+    for (spaces = new_line->start - old_line->start; spaces > 0; spaces--) {
+      t3_term_putc(' ');
+    }
+  }
 
-    width = _t3_terminal_window->lines[i].start;
-    old_width = _t3_old_data.start;
+  while (new_idx != new_line->length) {
+    int saved_old_idx, saved_new_idx, saved_width, same_count = 0;
+
+    /* Only check if old and new are the same if we are checking the same position. */
+    if (old_width == width) {
+      saved_old_idx = old_idx;
+      saved_new_idx = new_idx;
+      saved_width = width;
+
+      while (new_idx < new_line->length && old_idx < old_line->length) {
+        old_block_size = _t3_get_value(old_line->data + old_idx, &old_block_size_bytes);
+        new_block_size = _t3_get_value(new_line->data + new_idx, &new_block_size_bytes);
+        blocks_compared++;
+
+        /* Check if the next blocks are equal. If not, break. */
+        if (old_block_size != new_block_size ||
+            memcmp(old_line->data + old_idx + old_block_size_bytes,
+                   new_line->data + new_idx + new_block_size_bytes, old_block_size >> 1) != 0 ||
+            (debug_repaint && _t3_repaint_forced(width))) {
+          break;
+        }
+        same_count++;
+        width += _T3_BLOCK_SIZE_TO_WIDTH(old_block_size);
+        old_width = width;
+        old_idx += (old_block_size >> 1) + old_block_size_bytes;
+        new_idx += (new_block_size >> 1) + new_block_size_bytes;
+      }
 
-    if (width > old_width && _t3_old_data.width > 0) {
-      int spaces;
-      _t3_do_cup(i, _t3_old_data.start);
-      _t3_set_attrs(0);
+      if (new_idx >= new_line->length) {
+        break;
+      }
 
-      if (_t3_old_data.start + _t3_old_data.width < width) {
-        spaces = _t3_old_data.width;
-        old_idx = _t3_old_data.length;
-        old_width = _t3_old_data.start + _t3_old_data.width;
-        last_width = old_width;
+      if (same_count < 3 && old_idx < old_line->length) {
+        old_idx = saved_old_idx;
+        new_idx = saved_new_idx;
+        old_width = width = saved_width;
+        same_count++;
       } else {
-        spaces = _t3_terminal_window->lines[i].start - _t3_old_data.start;
-        while (old_idx < _t3_old_data.length) {
-          old_block_size = _t3_get_value(_t3_old_data.data + old_idx, &old_block_size_bytes);
-          if (old_width + _T3_BLOCK_SIZE_TO_WIDTH(old_block_size) > width) {
-            break;
-          }
-          old_width += _T3_BLOCK_SIZE_TO_WIDTH(old_block_size);
-          old_idx += (old_block_size >> 1) + old_block_size_bytes;
-        }
-        last_width = width;
+        /* Erase same_count, so we don't print unnecessary characters below. */
+        same_count = 0;
       }
+    }
 
-      for (spaces = _t3_terminal_window->lines[i].start - _t3_old_data.start; spaces > 0;
-           spaces--) {
-        t3_term_putc(' ');
+    if (attribute_output_bytes) {
+      attribute_output(&owner, &owner_mark, _t3_win_get_cell_owner(i, width));
+    }
+    if (width != last_width) {
+      if (last_width < 0 || _t3_hpa == NULL) {
+        _t3_do_cup(i, width);
+      } else {
+        size_t hpa_start = _t3_frame_length();
+        _t3_output_driver->hpa(width);
+        STATS_ADD(cursor_bytes, _t3_frame_length() - hpa_start);
       }
     }
 
-    while (new_idx != _t3_terminal_window->lines[i].length) {
-      int saved_old_idx, saved_new_idx, saved_width, same_count = 0;
-
-      /* Only check if old and new are the same if we are checking the same position. */
-      if (old_width == width) {
-        saved_old_idx = old_idx;
-        saved_new_idx = new_idx;
-        saved_width = width;
-
-        while (new_idx < _t3_terminal_window->lines[i].length && old_idx < _t3_old_data.length) {
-          old_block_size = _t3_get_value(_t3_old_data.data + old_idx, &old_block_size_bytes);
-          new_block_size =
-              _t3_get_value(_t3_terminal_window->lines[i].data + new_idx, &new_block_size_bytes);
-
-          /* Check if the next blocks are equal. If not, break. */
-          if (old_block_size != new_block_size ||
-              memcmp(_t3_old_data.data + old_idx + old_block_size_bytes,
-                     _t3_terminal_window->lines[i].data + new_idx + new_block_size_bytes,
-                     old_block_size >> 1) != 0) {
-            break;
-          }
-          same_count++;
-          width += _T3_BLOCK_SIZE_TO_WIDTH(old_block_size);
-          old_width = width;
-          old_idx += (old_block_size >> 1) + old_block_size_bytes;
-          new_idx += (new_block_size >> 1) + new_block_size_bytes;
-        }
+    do {
+      t3_attr_t new_attrs;
+      uint32_t new_attrs_value;
+      size_t new_attrs_bytes;
 
-        if (new_idx >= _t3_terminal_window->lines[i].length) {
-          break;
-        }
-
-        if (same_count < 3 && old_idx < _t3_old_data.length) {
-          old_idx = saved_old_idx;
-          new_idx = saved_new_idx;
-          old_width = width = saved_width;
-          same_count++;
-        } else {
-          /* Erase same_count, so we don't print unnecessary characters below. */
-          same_count = 0;
-        }
+      if (attribute_output_bytes) {
+        attribute_output(&owner, &owner_mark, _t3_win_get_cell_owner(i, width));
       }
-
-      if (width != last_width) {
-        if (last_width < 0 || _t3_hpa == NULL) {
-          _t3_do_cup(i, width);
-        } else {
-          _t3_putp(_t3_tparm(_t3_hpa, 1, width));
-        }
+      new_block_size = _t3_get_value(new_line->data + new_idx, &new_block_size_bytes);
+      new_idx += new_block_size_bytes;
+      new_attrs_value = _t3_get_value(new_line->data + new_idx, &new_attrs_bytes);
+      new_attrs = _t3_get_attr(_T3_BLOCK_ATTR_TO_INDEX(new_attrs_value));
+      if (debug_repaint && !(new_attrs & T3_ATTR_USER)) {
+        new_attrs = _t3_repaint_tint(width, _T3_BLOCK_SIZE_TO_WIDTH(new_block_size), new_attrs);
       }
 
-      do {
-        t3_attr_t new_attrs;
-        size_t new_attrs_bytes;
-
-        new_block_size =
-            _t3_get_value(_t3_terminal_window->lines[i].data + new_idx, &new_block_size_bytes);
-        new_idx += new_block_size_bytes;
-        new_attrs = _t3_get_attr(
-            _t3_get_value(_t3_terminal_window->lines[i].data + new_idx, &new_attrs_bytes));
-
-        if ((new_attrs & T3_ATTR_USER) && user_callback != NULL) {
-          user_callback(_t3_terminal_window->lines[i].data + new_idx + new_attrs_bytes,
-                        (new_block_size >> 1) - new_attrs_bytes,
-                        _T3_BLOCK_SIZE_TO_WIDTH(new_block_size), new_attrs);
-        } else {
-          if (new_attrs & T3_ATTR_ACS) {
-            if ((_t3_acs_override == _T3_ACS_AUTO && _t3_term_encoding == _T3_TERM_UTF8) ||
-                !t3_term_acs_available(
-                    _t3_terminal_window->lines[i].data[new_idx + new_attrs_bytes])) {
-              new_attrs &= ~T3_ATTR_ACS;
-              if (new_attrs != _t3_attrs) {
-                _t3_set_attrs(new_attrs);
-              }
-              t3_term_puts(
-                  get_default_acs(_t3_terminal_window->lines[i].data[new_idx + new_attrs_bytes]));
-            } else {
-              if (new_attrs != _t3_attrs) {
-                _t3_set_attrs(new_attrs);
-              }
-              /* ACS characters should be passed directly to the terminal, without
-                 character-set conversion. */
-              _t3_output_buffer_print();
-              fwrite(_t3_alternate_chars +
-                         _t3_terminal_window->lines[i].data[new_idx + new_attrs_bytes],
-                     1, 1, _t3_putp_file);
+      if ((new_attrs & T3_ATTR_USER) && user_callback != NULL) {
+        user_callback(new_line->data + new_idx + new_attrs_bytes,
+                      (new_block_size >> 1) - new_attrs_bytes,
+                      _T3_BLOCK_SIZE_TO_WIDTH(new_block_size), new_attrs);
+      } else {
+        if (new_attrs & T3_ATTR_ACS) {
+          if ((_t3_acs_override == _T3_ACS_AUTO && _t3_term_encoding == _T3_TERM_UTF8) ||
+              !t3_term_acs_available(new_line->data[new_idx + new_attrs_bytes])) {
+            new_attrs &= ~T3_ATTR_ACS;
+            if (new_attrs != _t3_attrs) {
+              _t3_set_attrs(new_attrs);
             }
+            t3_term_puts(get_default_acs(new_line->data[new_idx + new_attrs_bytes]));
           } else {
             if (new_attrs != _t3_attrs) {
               _t3_set_attrs(new_attrs);
             }
-            t3_term_putn(_t3_terminal_window->lines[i].data + new_idx + new_attrs_bytes,
-                         (new_block_size >> 1) - new_attrs_bytes);
+            /* ACS characters should be passed directly to the terminal, without
+               character-set conversion. */
+            _t3_output_buffer_print();
+            _t3_frame_putc(
+                _t3_alternate_chars[(unsigned char)new_line->data[new_idx + new_attrs_bytes]]);
           }
-        }
-        new_idx += new_block_size >> 1;
-        width += _T3_BLOCK_SIZE_TO_WIDTH(new_block_size);
-        same_count--;
-
-        while (old_idx < _t3_old_data.length) {
-          old_block_size = _t3_get_value(_t3_old_data.data + old_idx, &old_block_size_bytes);
-          if (old_width + _T3_BLOCK_SIZE_TO_WIDTH(old_block_size) > width) {
-            break;
+        } else {
+          char *run;
+          t3_bool needs_filter = (new_attrs_value & _T3_BLOCK_ATTR_FILTER) != 0;
+
+          if (new_attrs != _t3_attrs) {
+            _t3_set_attrs(new_attrs);
+          }
+          if (needs_filter || attribute_output_bytes || debug_repaint ||
+              (run = _t3_output_reserve_text(new_line->length - new_idx)) == NULL) {
+            _t3_output_block_text(new_line->data + new_idx + new_attrs_bytes,
+                                  (new_block_size >> 1) - new_attrs_bytes, needs_filter);
+          } else {
+            /* Copy the text of all following blocks with the same attributes at once, for as long
+               as this loop would print them anyway. The text of the blocks never takes more space
+               than the remainder of the line. */
+            size_t run_length = 0, text_length;
+
+            for (;;) {
+              text_length = (new_block_size >> 1) - new_attrs_bytes;
+              memcpy(run + run_length, new_line->data + new_idx + new_attrs_bytes, text_length);
+              run_length += text_length;
+              new_idx += new_block_size >> 1;
+              width += _T3_BLOCK_SIZE_TO_WIDTH(new_block_size);
+              same_count--;
+              skip_old_blocks(old_line, &old_idx, &old_width, width);
+
+              if ((old_width == width && same_count <= 0) || new_idx >= new_line->length) {
+                break;
+              }
+              new_block_size = _t3_get_value(new_line->data + new_idx, &new_block_size_bytes);
+              if (_t3_get_value(new_line->data + new_idx + new_block_size_bytes,
+                                &new_attrs_bytes) != new_attrs_value) {
+                break;
+              }
+              new_idx += new_block_size_bytes;
+            }
+            _t3_output_commit_text(run_length);
+            continue;
           }
-          old_width += _T3_BLOCK_SIZE_TO_WIDTH(old_block_size);
-          old_idx += (old_block_size >> 1) + old_block_size_bytes;
         }
-      } while ((old_width != width || same_count > 0) &&
-               new_idx < _t3_terminal_window->lines[i].length);
-      last_width = width;
-      _t3_output_buffer_print();
+      }
+      new_idx += new_block_size >> 1;
+      width += _T3_BLOCK_SIZE_TO_WIDTH(new_block_size);
+      same_count--;
+
+      skip_old_blocks(old_line, &old_idx, &old_width, width);
+    } while ((old_width != width || same_count > 0) && new_idx < new_line->length);
+    last_width = width;
+    _t3_output_buffer_print();
+  }
+  if (attribute_output_bytes) {
+    attribute_output(&owner, &owner_mark, NULL);
+  }
+
+  /* Clear the terminal line if the new line is shorter than the old one. */
+  if (new_line->start + new_line->width < old_line->start + old_line->width &&
+      width < terminal_width) {
+    if (last_width < 0) {
+      _t3_do_cup(i, 0);
     }
 
-    /* Clear the terminal line if the new line is shorter than the old one. */
-    if (_t3_terminal_window->lines[i].start + _t3_terminal_window->lines[i].width <
-            _t3_old_data.start + _t3_old_data.width &&
-        width < _t3_terminal_window->width) {
-      if (last_width < 0) {
-        _t3_do_cup(i, 0);
-      }
+    if (_t3_bce && (_t3_attrs & ~T3_ATTR_FG_MASK) != 0) {
+      _t3_set_attrs(0);
+    }
 
-      if (_t3_bce && (_t3_attrs & ~T3_ATTR_FG_MASK) != 0) {
-        _t3_set_attrs(0);
+    if (_t3_el != NULL) {
+      size_t el_start = _t3_frame_length();
+      _t3_output_driver->el();
+      STATS_ADD(cursor_bytes, _t3_frame_length() - el_start);
+    } else {
+      int max = old_line->start + old_line->width;
+      for (; width < max; width++) {
+        t3_term_putc(' ');
       }
+    }
+  }
+  _t3_output_buffer_print();
 
-      if (_t3_el != NULL) {
-        _t3_putp(_t3_el);
-      } else {
-        int max = _t3_old_data.start + _t3_old_data.width;
-        for (; width < max; width++) {
-          t3_term_putc(' ');
-        }
+  STATS_ADD(blocks_compared, blocks_compared);
+  if (_t3_frame_length() != frame_length) {
+    STATS_ADD(lines_emitted, 1);
+    TRACE(TRACE_LINE_EMIT, i, _t3_frame_length() - frame_length, 0);
+  }
+}
+
+/** Update a single line of the terminal.
+    @param i The line to update.
+
+    The line is composited from the windows, and compared to the current contents of the terminal.
+    Only the differences are sent to the terminal.
+*/
+static void update_line(int i) {
+  SWAP_LINES(_t3_old_data, _t3_terminal_window->lines[i]);
+  _t3_win_refresh_term_line(i);
+  _t3_emit_line(i, &_t3_terminal_window->lines[i], &_t3_old_data, _t3_terminal_window->width,
+                t3_true);
+}
+
+/** @internal
+    @brief Determine whether frames should be sent using synchronized output. */
+t3_bool _t3_use_sync_output(void) {
+  return _t3_sync_override == _T3_SYNC_ON ||
+         (_t3_sync_override == _T3_SYNC_AUTO && _t3_sync_output_supported);
+}
+
+/** @internal
+    @brief Send the control sequences required before sending the lines of a frame.
+    @param sync_output Boolean indicating whether to use synchronized output.
+    @param show_cursor Boolean indicating whether the cursor should be visible after the frame.
+    @param cursor_y The line at which the cursor should be positioned after the frame.
+    @param cursor_x The column at which the cursor should be positioned after the frame.
+
+    The cursor is hidden while the lines are sent, if the terminal allows it.
+*/
+void _t3_begin_frame(t3_bool sync_output, t3_bool show_cursor, int cursor_y, int cursor_x) {
+  /* Ask the terminal to hold off rendering until the complete frame has been received. Terminals
+     that do not support the synchronized output mode will simply ignore this sequence. */
+  if (sync_output) {
+    sync_begin_offset = _t3_frame_length();
+    _t3_frame_puts(SYNC_BEGIN);
+  }
+
+  if (_t3_civis != NULL) {
+    if (show_cursor != _t3_show_cursor) {
+      /* If the cursor should now be invisible, hide it before drawing. If the
+         cursor should now be visible, leave it invisible until after drawing. */
+      if (!show_cursor) {
+        _t3_putp(_t3_civis);
+      }
+    } else if (_t3_show_cursor) {
+      if (cursor_y == _t3_cursor_y && cursor_x == _t3_cursor_x) {
+        _t3_putp(_t3_sc);
       }
+      _t3_putp(_t3_civis);
     }
-    _t3_output_buffer_print();
   }
+  frame_content_offset = _t3_frame_length();
+}
 
-  /* _t3_set_attrs(0); */
+/** @internal
+    @brief Send the control sequences required after sending the lines of a frame.
+    @param sync_output Boolean indicating whether synchronized output was used.
+    @param show_cursor Boolean indicating whether the cursor should be visible after the frame.
+    @param cursor_y The line at which the cursor should be positioned after the frame.
+    @param cursor_x The column at which the cursor should be positioned after the frame.
+    @param height The height of the terminal.
+    @param width The width of the terminal.
+    @return Boolean indicating whether the frame was sent using synchronized output.
+
+    If no lines were drawn, the sequence starting synchronized output is removed again, such that
+    idle updates do not send a pair of sequences enclosing only the cursor positioning.
+*/
+t3_bool _t3_end_frame(t3_bool sync_output, t3_bool show_cursor, int cursor_y, int cursor_x,
+                      int height, int width) {
+  t3_bool empty = _t3_frame_length() == frame_content_offset;
+  size_t length;
 
   if (_t3_civis == NULL) {
-    _t3_show_cursor = new_show_cursor;
+    _t3_show_cursor = show_cursor;
     if (!_t3_show_cursor) {
-      _t3_do_cup(_t3_terminal_window->height, _t3_terminal_window->width);
+      _t3_do_cup(height, width);
     }
   } else {
-    if (new_show_cursor != _t3_show_cursor) {
+    if (show_cursor != _t3_show_cursor) {
       /* If the cursor should now be visible, move it to the right position and
-         show it. Otherwise, it was already hidden at the start of this routine. */
-      if (new_show_cursor) {
-        _t3_do_cup(new_cursor_y, new_cursor_x);
-        _t3_cursor_y = new_cursor_y;
-        _t3_cursor_x = new_cursor_x;
+         show it. Otherwise, it was already hidden at the start of the frame. */
+      if (show_cursor) {
+        _t3_do_cup(cursor_y, cursor_x);
+        _t3_cursor_y = cursor_y;
+        _t3_cursor_x = cursor_x;
         _t3_putp(_t3_cnorm);
       }
-      _t3_show_cursor = new_show_cursor;
+      _t3_show_cursor = show_cursor;
     } else if (_t3_show_cursor) {
-      if (new_cursor_y == _t3_cursor_y && new_cursor_x == _t3_cursor_x && _t3_rc != NULL) {
+      if (cursor_y == _t3_cursor_y && cursor_x == _t3_cursor_x && _t3_rc != NULL) {
         _t3_putp(_t3_rc);
       } else {
-        _t3_do_cup(new_cursor_y, new_cursor_x);
+        _t3_do_cup(cursor_y, cursor_x);
       }
-      _t3_cursor_y = new_cursor_y;
-      _t3_cursor_x = new_cursor_x;
+      _t3_cursor_y = cursor_y;
+      _t3_cursor_x = cursor_x;
       _t3_putp(_t3_cnorm);
     }
   }
 
-  fflush(_t3_putp_file);
+  if (!sync_output) {
+    return t3_false;
+  }
+  if (empty) {
+    length = _t3_frame_length();
+    memmove(_t3_frame_get(sync_begin_offset), _t3_frame_get(sync_begin_offset + SYNC_BEGIN_LENGTH),
+            length - sync_begin_offset - SYNC_BEGIN_LENGTH);
+    _t3_frame_truncate(length - SYNC_BEGIN_LENGTH);
+    return t3_false;
+  }
+  _t3_frame_puts(SYNC_END);
+  return t3_true;
+}
+
+/** Check whether the current update should stop before drawing the next line.
+    @param checked_length The length of the frame buffer at the last check for pending input.
+*/
+static t3_bool update_interrupted(size_t *checked_length) {
+  if (update_byte_limit != 0 && _t3_frame_length() >= update_byte_limit) {
+    return t3_true;
+  }
+  if (update_deadline != 0 && _t3_monotonic_usec() >= update_deadline) {
+    return t3_true;
+  }
+
+  /* If the user has typed ahead, stop drawing such that the input can be handled first. The
+     remaining lines are left untouched, and will be drawn by the next update. To ensure that each
+     update makes progress, input is only checked after a line that required output. */
+  if (typeahead_check && _t3_frame_length() != *checked_length) {
+    if (_t3_input_pending()) {
+      return t3_true;
+    }
+    *checked_length = _t3_frame_length();
+  }
+  return t3_false;
+}
+
+/** Determine which lines should be drawn first in a bounded update.
+    @return A boolean indicating whether the priority_lines array is valid.
+
+    The priority lines are the line containing the cursor, if it is shown, and the lines covered by
+    windows marked with ::t3_win_set_priority.
+*/
+static t3_bool set_priority_lines(void) {
+  if (priority_lines_allocated < _t3_lines) {
+    char *new_priority_lines = realloc(priority_lines, _t3_lines);
+    if (new_priority_lines == NULL) {
+      return t3_false;
+    }
+    priority_lines = new_priority_lines;
+    priority_lines_allocated = _t3_lines;
+  }
+  memset(priority_lines, 0, _t3_lines);
+  _t3_win_mark_priority_lines(priority_lines, _t3_lines);
+  if (new_show_cursor && new_cursor_y >= 0 && new_cursor_y < _t3_lines) {
+    priority_lines[new_cursor_y] = 1;
+  }
+  return t3_true;
+}
+
+/** @internal
+    @brief Free the memory used for prioritizing lines in bounded updates. */
+void _t3_free_priority_lines(void) {
+  free(priority_lines);
+  priority_lines = NULL;
+  priority_lines_allocated = 0;
+}
+
+/** Update the terminal.
+    @param bounded Boolean indicating whether to draw the priority lines first, and to continue
+        with the line at which the previous bounded update stopped.
+    @param usec The maximum time to spend in microseconds, or a value <= 0 for no limit.
+    @param bytes The maximum number of bytes to add to the frame, or 0 for no limit.
+    @return A boolean indicating whether all lines were updated.
+*/
+static t3_bool update_terminal(t3_bool bounded, int usec, size_t bytes) {
+  int i, n, first_line, lines_updated = 0;
+  size_t checked_length;
+  t3_bool complete = t3_true, use_priority_lines;
+  t3_bool sync_output = _t3_use_sync_output();
+  int64_t start = _t3_monotonic_usec();
+
+  if (min_frame_interval > 0) {
+    /* If the previous frame was emitted too recently, only remember that an update is needed. The
+       window contents are only composited when the frame is actually emitted, so all intermediate
+       states are dropped. */
+    if (start - last_frame_time < min_frame_interval) {
+      frame_pending = t3_true;
+      return t3_false;
+    }
+    last_frame_time = start;
+  }
+  frame_pending = t3_false;
+  TRACE(TRACE_FRAME_BEGIN, 0, 0, 0);
+
+  if (_t3_async_output_active()) {
+    /* Only composite the lines here. Comparing them to the terminal contents and sending the
+       differences is done by the writer thread. */
+    if (_t3_detection_needs_finishing) {
+      _t3_lock_output_state();
+      _t3_init_output_converter(_t3_current_charset);
+      _t3_set_alternate_chars_defaults();
+      _t3_unlock_output_state();
+      _t3_win_update_filter_flags();
+      t3_term_redraw();
+      _t3_detection_needs_finishing = t3_false;
+    }
+    _t3_win_lock_all();
+    for (i = 0; i < _t3_lines; i++) {
+      _t3_win_refresh_term_line(i);
+    }
+    _t3_win_unlock_all();
+    complete = _t3_async_publish(new_show_cursor, new_cursor_y, new_cursor_x, sync_output);
+    TRACE(TRACE_FRAME_END, _t3_lines, 0, complete);
+    _t3_stats_end_frame(start);
+    _t3_win_stats_end_frame();
+    return complete;
+  }
+
+  update_deadline = usec > 0 ? _t3_monotonic_usec() + usec : 0;
+
+  nr_of_line_boundaries = 0;
+  if (_t3_nonblocking_output) {
+    /* Give the terminal a chance to accept more of the previous frame. Whatever it has not accepted
+       by now is out of date, and is replaced by the new frame. */
+    _t3_frame_try_flush();
+    if (_t3_frame_written_length() < _t3_frame_length()) {
+      abandon_stale_output();
+    }
+
+    if (line_boundaries_allocated < _t3_lines + 1) {
+      line_boundary_t *new_boundaries =
+          realloc(line_boundaries, (_t3_lines + 1) * sizeof(line_boundary_t));
+      if (new_boundaries != NULL) {
+        line_boundaries = new_boundaries;
+        line_boundaries_allocated = _t3_lines + 1;
+      }
+    }
+  }
+  frame_sync_output = sync_output;
+  update_byte_limit = bytes > 0 ? _t3_frame_length() + bytes : 0;
+
+  if (_t3_detection_needs_finishing) {
+    _t3_init_output_converter(_t3_current_charset);
+    _t3_set_alternate_chars_defaults();
+    _t3_win_update_filter_flags();
+    t3_term_redraw();
+    _t3_detection_needs_finishing = t3_false;
+  }
+
+  _t3_begin_frame(sync_output, new_show_cursor, new_cursor_y, new_cursor_x);
+
+  if (_t3_debug_repaint == DEBUG_REPAINT_HEAT_MAP) {
+    _t3_repaint_paint_heat_map();
+  }
+
+  /* Prevent other threads from painting while the windows are composited. */
+  _t3_win_lock_all();
+  use_priority_lines = bounded && set_priority_lines();
+  if (use_priority_lines) {
+    /* Priority lines are always drawn, regardless of the budget. */
+    for (i = 0; i < _t3_lines; i++) {
+      if (!priority_lines[i]) {
+        continue;
+      }
+      if (_t3_nonblocking_output) {
+        record_line_boundary(i);
+      }
+      update_line(i);
+      lines_updated++;
+    }
+  }
+
+  /* Bounded updates continue where the previous one stopped, such that all lines are eventually
+     drawn even if the budget is always exhausted before reaching the last line. */
+  first_line = bounded && resume_line < _t3_lines ? resume_line : 0;
+  checked_length = _t3_frame_length();
+  for (n = 0; n < _t3_lines; n++) {
+    i = (first_line + n) % _t3_lines;
+    if (use_priority_lines && priority_lines[i]) {
+      continue;
+    }
+
+    if (update_interrupted(&checked_length)) {
+      resume_line = i;
+      complete = t3_false;
+      break;
+    }
+
+    if (_t3_nonblocking_output) {
+      record_line_boundary(i);
+    }
+    update_line(i);
+    lines_updated++;
+  }
+  _t3_win_unlock_all();
+
+  if (_t3_nonblocking_output) {
+    record_line_boundary(-1);
+  }
+
+  if (!_t3_end_frame(sync_output, new_show_cursor, new_cursor_y, new_cursor_x,
+                     _t3_terminal_window->height, _t3_terminal_window->width) &&
+      sync_output) {
+    /* No lines were drawn, and the start of the synchronized output was removed. The recorded
+       boundaries point past the end of the frame, but there is no line output to abandon. */
+    frame_sync_output = t3_false;
+    nr_of_line_boundaries = 0;
+  }
+  flush_output();
+
+  if (!complete) {
+    frame_pending = t3_true;
+  }
+  STATS_ADD(lines_skipped, _t3_lines - lines_updated);
+  TRACE(TRACE_FRAME_END, lines_updated, _t3_frame_length() - _t3_frame_written_length(), complete);
+  _t3_stats_end_frame(start);
+  _t3_win_stats_end_frame();
+  return complete;
+}
+
+/** Update the terminal, drawing all changes since last refresh.
+
+    After changing window contents, this function should be called to make those
+    changes visible on the terminal. The refresh is not done automatically to allow
+    programs to bunch many separate updates. Generally this is called right before
+    ::t3_term_get_keychar.
+*/
+void t3_term_update(void) { update_terminal(t3_false, 0, 0); }
+
+/** Update the terminal, limiting the time spent and the amount of data sent.
+    @param usec The maximum time to spend in microseconds, or a value <= 0 for no limit.
+    @param bytes The maximum number of bytes to send to the terminal, or 0 for no limit.
+    @return A boolean indicating whether the terminal was updated completely.
+
+    This function works like ::t3_term_update, except that it stops drawing lines once either of
+    the limits has been reached. The line containing the cursor and the lines covered by windows
+    marked with ::t3_win_set_priority are drawn first, and are always drawn completely. The
+    remaining lines are drawn until the budget is exhausted. The next call continues with the
+    first line that was not drawn. The limits are checked between lines, so they may be exceeded
+    by the amount of time or data needed for a single line.
+
+    If the update was not complete, ::t3_term_get_update_timeout reports that an update is pending.
+*/
+t3_bool t3_term_update_bounded(int usec, size_t bytes) {
+  return update_terminal(t3_true, usec, bytes);
 }
 
+/** Limit the number of frames emitted by ::t3_term_update per second.
+    @param fps The maximum number of frames per second, or a value <= 0 to disable the limit.
+
+    When a maximum frame rate is set, calls to ::t3_term_update that occur too soon after the
+    previous frame was emitted do not update the terminal. Instead the update is marked as pending,
+    and the program should call ::t3_term_update again after the time returned by
+    ::t3_term_get_update_timeout. Because the window contents are only used when the frame is
+    actually emitted, intermediate states are never shown. This is useful for programs that change
+    their windows far more often than the user can observe.
+
+    The maximum frame rate can also be set through the @c max_fps option in the @c T3WINDOW_OPTS
+    environment variable.
+*/
+void t3_term_set_max_frame_rate(int fps) {
+  min_frame_interval = fps <= 0 ? 0 : 1000000 / fps;
+}
+
+/** Get the time until a deferred update should be emitted.
+    @return -1 if no update is pending, or otherwise the number of milliseconds after which
+        ::t3_term_update should be called to emit the pending frame.
+
+    The return value is suitable for passing to ::t3_term_get_keychar, except when it is 0 or -1.
+    When 0 is returned, the pending frame is due and ::t3_term_update should be called right away.
+    A typical event loop looks like this:
+    @code
+        int timeout;
+        while (1) {
+          timeout = t3_term_get_update_timeout();
+          if (timeout == 0) {
+            t3_term_update();
+            continue;
+          }
+          key = t3_term_get_keychar(timeout);
+          if (key == T3_ERR_TIMEOUT) {
+            t3_term_update();
+            continue;
+          }
+          ...
+        }
+    @endcode
+
+    When the @c debug_repaint option is included in the @c T3WINDOW_OPTS environment variable, each
+    update briefly tints the cells that it sent to the terminal. With @c debug_repaint=heatmap, the
+    number of times each area of the terminal was changed is also shown in the top-right corner. In
+    this mode, this function also reports when an update is needed to remove the tint.
+*/
+int t3_term_get_update_timeout(void) {
+  int64_t remaining;
+  int repaint_timeout = _t3_repaint_timeout(), timeout;
+
+  if (!frame_pending) {
+    return repaint_timeout;
+  }
+  remaining = min_frame_interval - (_t3_monotonic_usec() - last_frame_time);
+  timeout = remaining <= 0 ? 0 : (int)((remaining + 999) / 1000);
+  return repaint_timeout >= 0 && repaint_timeout < timeout ? repaint_timeout : timeout;
+}
+
+/** Set whether ::t3_term_update should stop early when user input is pending.
+    @param check Boolean indicating whether to check for pending input.
+
+    When enabled, ::t3_term_update checks whether input is available after each line that was
+    changed. If so, it stops updating the terminal, such that the program can first handle the
+    input. This avoids spending time on screen contents which will be out of date once the input
+    is processed, for example when a key is held down. The remaining lines are drawn by the next
+    call to ::t3_term_update. While the update is incomplete, ::t3_term_get_update_timeout reports
+    that an update is pending.
+*/
+void t3_term_set_typeahead_check(t3_bool check) { typeahead_check = check; }
+
 /** Redraw the entire terminal from scratch. */
 void t3_term_redraw(void) {
-  /* The clear action destroys the current cursor position, so we make sure
-     that it has to be repositioned afterwards. Because we are redrawing, we
-     definately also want to ensure that the cursor is in the right place. */
-  if (new_show_cursor && _t3_show_cursor) {
-    _t3_cursor_x = new_cursor_x + 1;
-  }
-  _t3_set_attrs(0);
-  _t3_putp(_t3_clear);
+  if (_t3_async_output_active()) {
+    _t3_async_request(ASYNC_REDRAW);
+  } else {
+    /* The clear action destroys the current cursor position, so we make sure
+       that it has to be repositioned afterwards. Because we are redrawing, we
+       definately also want to ensure that the cursor is in the right place. */
+    if (new_show_cursor && _t3_show_cursor) {
+      _t3_cursor_x = new_cursor_x + 1;
+    }
+    _t3_set_attrs(0);
+    _t3_putp(_t3_clear);
+  }
   t3_win_set_paint(_t3_terminal_window, 0, 0);
   t3_win_clrtobot(_t3_terminal_window);
 }
@@ -916,19 +1644,30 @@ int t3_term_strnwidth(const char *str, size_t n) { return t3_term_strncwidth(str
     on the terminal screen. This function is provided to calculate that value.
 */
 size_t t3_term_strncwidth(const char *str, size_t n) {
-  size_t bytes_read;
-  int width, width_state = 0, retval = 0;
-  uint32_t c;
+  size_t width;
 
-  for (; n > 0; n -= bytes_read, str += bytes_read) {
-    bytes_read = n;
-    c = t3_utf8_get(str, &bytes_read);
+  _t3_utf8_width_prefix(str, n, SIZE_MAX, &width);
+  return width;
+}
 
-    width = t3_utf8_wcwidth_ext(c, &width_state);
-    if (width < 0) {
-      continue;
-    }
-    retval += width;
+/** Find the longest prefix of a string that fits in a number of character cells.
+    @param str The string to measure.
+    @param n The length of @p str.
+    @param max_width The maximum width of the prefix in character cells.
+    @param width The location to store the width of the prefix in character cells (may be
+        @c NULL).
+    @return The length of the prefix in bytes.
+
+    Zero-width characters directly following the prefix, such as combining marks, are included in
+    the prefix. This allows truncating a string to a number of columns in a single pass, instead
+    of calling ::t3_term_strncwidth repeatedly.
+*/
+size_t t3_term_strncwidth_prefix(const char *str, size_t n, size_t max_width, size_t *width) {
+  size_t prefix_width, retval;
+
+  retval = _t3_utf8_width_prefix(str, n, max_width, &prefix_width);
+  if (width != NULL) {
+    *width = prefix_width;
   }
   return retval;
 }
@@ -79,6 +79,47 @@ typedef struct {
   int cap_flags; /**< A bitmask of T3_TERM_CAP_* flags indicating capabilities of the terminal. */
 } t3_term_caps_t;
 
+/** Counters for the work done by the library. See ::t3_term_get_stats.
+
+    All counters count the work done since the previous frame was emitted, or in total. Painting
+    windows is counted towards the frame that is emitted next.
+*/
+typedef struct {
+  unsigned long lines_composited; /**< Terminal lines composited from the windows. */
+  unsigned long lines_skipped;    /**< Terminal lines not updated as an update stopped early. */
+  unsigned long lines_emitted;    /**< Terminal lines for which output was generated. */
+  unsigned long blocks_compared;  /**< Character blocks compared to the terminal contents. */
+  unsigned long bytes_written;    /**< Bytes written to the terminal. */
+  unsigned long text_bytes;   /**< Bytes of text output, included in @c bytes_written. */
+  unsigned long sgr_bytes;    /**< Bytes for setting attributes, included in @c bytes_written. */
+  unsigned long cursor_bytes; /**< Bytes for moving the cursor and clearing to the end of a line,
+                                   included in @c bytes_written. */
+  unsigned long set_attrs_calls;    /**< Number of times the attributes were set. */
+  unsigned long cup_calls;          /**< Number of times the cursor was moved to a position. */
+  unsigned long write_blocks_calls; /**< Number of times character blocks were added to a window. */
+  unsigned long memmove_bytes; /**< Bytes moved to make room for characters added to windows. */
+} t3_term_frame_stats_t;
+
+/** Number of buckets in the latency histogram in ::t3_term_stats_t. */
+#define T3_TERM_STATS_HISTOGRAM_SIZE 24
+
+/** Data structure to store the performance counters of the library.
+
+    See ::t3_term_get_stats for details on how to use this struct.
+*/
+typedef struct {
+  t3_term_frame_stats_t last_frame; /**< Counters for the last emitted frame. */
+  t3_term_frame_stats_t totals;     /**< Counters for all frames. */
+  unsigned long frames;             /**< Number of frames emitted. */
+  /** Histogram of the time spent in ::t3_term_update for emitted frames. Element 0 counts updates
+      that took less than 2 microseconds, element @c i counts updates that took at least @c 2^i
+      and less than @c 2^(i+1) microseconds. The last element also counts all longer updates. */
+  unsigned long update_latency[T3_TERM_STATS_HISTOGRAM_SIZE];
+  unsigned long max_update_latency; /**< The longest time spent in ::t3_term_update in
+                                         microseconds. */
+  size_t attr_map_size;             /**< Number of distinct attribute sets in use. */
+} t3_term_stats_t;
+
 /** Terminal capability flag: terminal can set foreground. */
 #define T3_TERM_CAP_FG (1 << 0)
 /** Terminal capability flag: terminal can set foreground. */
@@ -252,7 +293,13 @@ T3_WINDOW_API void t3_term_get_size(int *height, int *width);
 T3_WINDOW_API t3_bool t3_term_resize(void);
 T3_WINDOW_API void t3_term_update_cursor(void);
 T3_WINDOW_API void t3_term_update(void);
+T3_WINDOW_API t3_bool t3_term_update_bounded(int usec, size_t bytes);
 T3_WINDOW_API void t3_term_redraw(void);
+T3_WINDOW_API void t3_term_set_max_frame_rate(int fps);
+T3_WINDOW_API int t3_term_get_update_timeout(void);
+T3_WINDOW_API t3_bool t3_term_set_nonblocking_output(t3_bool nonblocking);
+T3_WINDOW_API void t3_term_set_typeahead_check(t3_bool check);
+T3_WINDOW_API t3_bool t3_term_set_async_output(t3_bool async);
 T3_WINDOW_API void t3_term_set_attrs(t3_attr_t new_attrs);
 T3_WINDOW_API void t3_term_set_user_callback(t3_attr_user_callback_t callback);
 T3_WINDOW_API int t3_term_unget_keychar(int c);
@@ -265,6 +312,8 @@ T3_WINDOW_API int t3_term_strwidth(const char *str);
 
 T3_WINDOW_API size_t t3_term_strncwidth(const char *str, size_t n);
 T3_WINDOW_API size_t t3_term_strcwidth(const char *str);
+T3_WINDOW_API size_t t3_term_strncwidth_prefix(const char *str, size_t n, size_t max_width,
+                                               size_t *width);
 
 T3_WINDOW_API t3_attr_t t3_term_combine_attrs(t3_attr_t a, t3_attr_t b);
 T3_WINDOW_API t3_attr_t t3_term_get_ncv(void);
@@ -277,6 +326,8 @@ T3_WINDOW_API void t3_term_set_replacement_char(int c);
 T3_WINDOW_API t3_bool t3_term_putc(char c);
 T3_WINDOW_API t3_bool t3_term_puts(const char *s);
 T3_WINDOW_API t3_bool t3_term_putn(const char *s, size_t n);
+T3_WINDOW_API char *t3_term_reserve(size_t n);
+T3_WINDOW_API void t3_term_commit(size_t n);
 
 /** Get terminal capabilities.
     @param caps The location to store the capabilites.
@@ -289,6 +340,19 @@ T3_WINDOW_API t3_bool t3_term_putn(const char *s, size_t n);
 #define t3_term_get_caps(caps) t3_term_get_caps_internal((caps), T3_WINDOW_VERSION)
 
 T3_WINDOW_API void t3_term_get_caps_internal(t3_term_caps_t *caps, int version);
+
+/** Get the performance counters of the library.
+    @param stats The location to store the counters.
+    @ingroup t3window_term
+
+    This define calls ::t3_term_get_stats_internal with the correct version argument.
+*/
+#define t3_term_get_stats(stats) t3_term_get_stats_internal((stats), T3_WINDOW_VERSION)
+
+T3_WINDOW_API void t3_term_get_stats_internal(t3_term_stats_t *stats, int version);
+T3_WINDOW_API void t3_term_reset_stats(void);
+T3_WINDOW_API void t3_term_set_trace(t3_bool enable);
+T3_WINDOW_API t3_bool t3_term_trace_dump(int fd);
 T3_WINDOW_API int t3_term_get_modifiers_hack(void);
 
 #ifdef __cplusplus
@@ -14,11 +14,14 @@
 
 #if defined(GENERATE_STRINGS)
 #define TEST(_str, _code) send_test_string(_str);
+#define QUERY(_str) send_query(_str);
 #elif defined(GENERATE_CODE)
 #define TEST(_str, _code)    \
   if (test++ == report_nr) { \
     _code                    \
   }
+/* Responses to queries are handled by process_mode_report, and do not count as a report. */
+#define QUERY(_str)
 {
   int test = 0;
 #endif
@@ -32,6 +35,15 @@
 // FIXME: test for more encodings here
 // FIXME: extend the GB18030 testing
 
+/*=== Queries ===*/
+
+/* Queries are sent before the test strings. The responses to the queries are therefore received
+   before the final position report, which ends the detection. Terminals that do not understand
+   the queries simply ignore them. */
+
+/* DECRQM for private mode 2026: synchronized output. */
+QUERY("\033[?2026$p")
+
 /*=== Basic character set detection ===*/
 
 /* This string should be 3 characters wide, if UTF-8 is supported. All characters are from
@@ -86,3 +98,4 @@ if (detecting_terminal_capabilities && test - 1 == report_nr) {
 }
 #endif
 #undef TEST
+#undef QUERY
@@ -14,6 +14,7 @@
 /** @file */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,9 +34,14 @@
 
 #include <transcript/transcript.h>
 
+#include "async_output.h"
+#include "capability.h"
 #include "convert_output.h"
+#include "debug_repaint.h"
+#include "frame_buffer.h"
 #include "internal.h"
 #include "log.h"
+#include "output_driver.h"
 #include "window.h"
 
 /* The curses header file defines too many symbols that get in the way of our
@@ -61,7 +67,14 @@ static struct termios saved; /**< Terminal state as saved in ::t3_term_init */
 static t3_bool initialised,  /**< Boolean indicating whether the terminal has been initialised. */
     seqs_initialised,     /**< Boolean indicating whether the terminal control sequences have been
                              initialised. */
-    transcript_init_done; /**< Boolean indicating whether @c transcript_init was called. */
+    transcript_init_done, /**< Boolean indicating whether @c transcript_init was called. */
+    use_terminfo_driver;  /**< Boolean indicating whether the built-in output drivers should not be
+                             used. */
+
+/** @internal Boolean indicating whether output to the terminal should be done without blocking. */
+t3_bool _t3_nonblocking_output;
+/** Boolean indicating whether the terminal file descriptor was in non-blocking mode already. */
+static t3_bool fd_was_nonblocking;
 
 /** @internal Store whether the terminal is actually the screen program.
 
@@ -285,12 +298,12 @@ static void send_test_string(const char *str) {
      Also, make sure we use line 1, iso line 0, because xterm uses \e[1;<digit>R for
      some combinations of F3 with modifiers and high-numbered function keys. :-( */
   if (_t3_hpa != NULL) {
-    _t3_putp(_t3_tparm(_t3_hpa, 1, 0));
+    _t3_putp_cap(&_t3_hpa_cap, 0, 0);
   } else {
     _t3_do_cup(1, 0);
   }
 
-  fputs(str, _t3_putp_file);
+  _t3_frame_puts(str);
   /* Send ANSI cursor reporting string. */
   if (_t3_terminal_is_screen) {
     _t3_putp("\033P\033[6n\033\\");
@@ -299,6 +312,17 @@ static void send_test_string(const char *str) {
   }
 }
 
+/** Send a query to the terminal, of which the response is handled by the detection code.
+
+    Queries are not sent to the screen program, because it does not implement them itself. Passing
+    them on to the outer terminal would give the capabilities of the wrong terminal.
+*/
+static void send_query(const char *str) {
+  if (!_t3_terminal_is_screen) {
+    _t3_putp(str);
+  }
+}
+
 /** Check if a terminfo string equals another string.
 
     Terminfo strings may contain timing/padding information, so a simple string
@@ -495,6 +519,12 @@ static int init_sequences(const char *term) {
     }
   }
 
+  _t3_compile_cap(&_t3_cup_cap, _t3_cup, 2);
+  _t3_compile_cap(&_t3_hpa_cap, _t3_hpa, 1);
+  _t3_compile_cap(&_t3_vpa_cap, _t3_vpa, 1);
+  _t3_compile_cap(&_t3_cud_cap, _t3_cud, 1);
+  _t3_compile_cap(&_t3_cuf_cap, _t3_cuf, 1);
+
   /* Enable alternate character set if required by terminal. */
   if ((enacs = get_ti_string("enacs")) != NULL) {
     _t3_putp(enacs);
@@ -621,6 +651,26 @@ static void integrate_environment(void) {
       override_colors(_t3_colors, value);
     } else if (check_opt(opts, "ansi=off")) {
       _t3_ansi_attrs = 0;
+    } else if (check_num_opt(opts, "max_fps=", &value)) {
+      t3_term_set_max_frame_rate(value);
+    } else if (check_opt(opts, "sync=on")) {
+      _t3_sync_override = _T3_SYNC_ON;
+    } else if (check_opt(opts, "sync=off")) {
+      _t3_sync_override = _T3_SYNC_OFF;
+    } else if (check_opt(opts, "sync=auto")) {
+      _t3_sync_override = _T3_SYNC_AUTO;
+    } else if (check_opt(opts, "driver=terminfo")) {
+      use_terminfo_driver = t3_true;
+    } else if (check_opt(opts, "driver=auto")) {
+      use_terminfo_driver = t3_false;
+    } else if (check_opt(opts, "trace=on")) {
+      t3_term_set_trace(t3_true);
+    } else if (check_opt(opts, "trace=off")) {
+      t3_term_set_trace(t3_false);
+    } else if (check_opt(opts, "debug_repaint")) {
+      _t3_debug_repaint = DEBUG_REPAINT_TINT;
+    } else if (check_opt(opts, "debug_repaint=heatmap")) {
+      _t3_debug_repaint = DEBUG_REPAINT_HEAT_MAP;
     }
     while (*opts != 0 && *opts != ' ') {
       opts++;
@@ -628,6 +678,24 @@ static void integrate_environment(void) {
   }
 }
 
+/** Set or clear the @c O_NONBLOCK flag on the terminal output file descriptor.
+    @param nonblocking Boolean indicating whether the flag should be set.
+*/
+static t3_bool set_output_nonblocking(t3_bool nonblocking) {
+  int flags = fcntl(_t3_terminal_out_fd, F_GETFL);
+
+  if (flags < 0) {
+    return t3_false;
+  }
+  if (nonblocking) {
+    fd_was_nonblocking = (flags & O_NONBLOCK) != 0;
+    flags |= O_NONBLOCK;
+  } else if (!fd_was_nonblocking) {
+    flags &= ~O_NONBLOCK;
+  }
+  return fcntl(_t3_terminal_out_fd, F_SETFL, flags) == 0;
+}
+
 /** Initialize the terminal.
     @param fd The file descriptor of the terminal or -1 for default.
     @param term The name of the terminal, or @c NULL to use the @c TERM environment variable.
@@ -665,10 +733,9 @@ int t3_term_init(int fd, const char *term) {
     return T3_ERR_SUCCESS;
   }
 
-  if (_t3_putp_file == NULL) {
-    /* We dup the fd, because when we use fclose on the FILE that we fdopen
-       it will close the underlying fd. This should not however close the
-       fd we have been passed or STDOUT. */
+  if (_t3_terminal_out_fd < 0) {
+    /* We dup the fd, because we close the output fd in t3_term_deinit. This
+       should not however close the fd we have been passed or STDOUT. */
     if (fd >= 0) {
       if (!isatty(fd)) {
         return T3_ERR_NOT_A_TTY;
@@ -676,7 +743,7 @@ int t3_term_init(int fd, const char *term) {
       if ((_t3_terminal_in_fd = _t3_terminal_out_fd = dup(fd)) == -1) {
         return T3_ERR_ERRNO;
       }
-    } else if (_t3_putp_file == NULL) {
+    } else {
       if (!isatty(STDOUT_FILENO) || !isatty(STDIN_FILENO)) {
         return T3_ERR_NOT_A_TTY;
       }
@@ -686,13 +753,6 @@ int t3_term_init(int fd, const char *term) {
       _t3_terminal_in_fd = STDIN_FILENO;
     }
 
-    if ((_t3_putp_file = fdopen(_t3_terminal_out_fd, "w")) == NULL) {
-      int saved_errno = errno;
-      close(_t3_terminal_out_fd);
-      errno = saved_errno;
-      return T3_ERR_ERRNO;
-    }
-
     detect_terminal_hacks(term);
 
     FD_ZERO(&_t3_inset);
@@ -706,6 +766,8 @@ int t3_term_init(int fd, const char *term) {
     }
 
     integrate_environment();
+    _t3_clear_sgr_cache();
+    _t3_output_driver = use_terminfo_driver ? &_t3_terminfo_driver : _t3_select_output_driver();
     seqs_initialised = t3_true;
   }
 
@@ -787,7 +849,7 @@ int t3_term_init(int fd, const char *term) {
        some combinations of F3 with modifiers and high-numbered function keys. :-( */
     if (_t3_hpa != NULL) {
       if (_t3_vpa != NULL) {
-        _t3_putp(_t3_tparm(_t3_vpa, 1, 1));
+        _t3_putp_cap(&_t3_vpa_cap, 1, 0);
       } else {
         _t3_do_cup(1, 0);
       }
@@ -803,7 +865,7 @@ int t3_term_init(int fd, const char *term) {
 #include "terminal_detection.h"
 #undef GENERATE_STRINGS
     _t3_putp(_t3_clear);
-    fflush(_t3_putp_file);
+    _t3_frame_flush();
   }
 
   if (detect_terminal_size) {
@@ -823,6 +885,14 @@ int t3_term_init(int fd, const char *term) {
 
   _t3_init_output_buffer();
 
+  if (_t3_nonblocking_output) {
+    set_output_nonblocking(t3_true);
+  }
+  /* If the writer thread can not be started, simply fall back to synchronous output. */
+  if (_t3_async_output) {
+    _t3_start_async_output();
+  }
+
   if (!only_once) {
     _t3_init_attr_map();
     only_once = t3_true;
@@ -835,6 +905,7 @@ int t3_term_init(int fd, const char *term) {
 /** Restore terminal state (de-initialize). */
 void t3_term_restore(void) {
   if (initialised) {
+    _t3_stop_async_output();
     /* Ensure complete repaint of the terminal on re-init (if required) */
     t3_win_set_paint(_t3_terminal_window, 0, 0);
     t3_win_clrtobot(_t3_terminal_window);
@@ -848,13 +919,83 @@ void t3_term_restore(void) {
       _t3_putp(_t3_clear);
       _t3_attrs = 0;
       do_rmcup();
-      fflush(_t3_putp_file);
+      _t3_frame_flush();
+    }
+    if (_t3_nonblocking_output) {
+      set_output_nonblocking(t3_false);
     }
     tcsetattr(_t3_terminal_in_fd, TCSADRAIN, &saved);
     initialised = t3_false;
   }
 }
 
+/** Set whether output to the terminal should be done without blocking.
+    @param nonblocking Boolean indicating whether ::t3_term_update should avoid blocking.
+    @return A boolean indicating whether the mode could be changed.
+
+    In non-blocking mode, ::t3_term_update and ::t3_term_update_cursor write as much of the frame
+    as the terminal accepts, and keep the rest. If the frame has not been written completely when
+    ::t3_term_update is called again, it is out of date. The library then stops sending the rest
+    of the old frame at the start of the first line that has not been sent yet. The lines that were
+    not sent are redrawn in full as part of the new frame. This keeps a program responsive over
+    slow connections, because only the most recent screen contents are sent.
+
+    To achieve this, the @c O_NONBLOCK flag is set on the terminal file descriptor while the
+    terminal is initialized. Note that this flag is normally shared with the standard input and
+    output of the program. It is reset by ::t3_term_restore.
+*/
+t3_bool t3_term_set_nonblocking_output(t3_bool nonblocking) {
+  if (initialised && nonblocking != _t3_nonblocking_output) {
+    if (!set_output_nonblocking(nonblocking)) {
+      return t3_false;
+    }
+  }
+  _t3_nonblocking_output = nonblocking;
+  return t3_true;
+}
+
+/** Set whether output to the terminal should be done by a separate thread.
+    @param async Boolean indicating whether ::t3_term_update should hand off the output.
+    @return A boolean indicating whether the mode could be changed. If the library was compiled
+        without thread support, enabling asynchronous output always fails.
+
+    In asynchronous output mode, ::t3_term_update only composites the windows and copies the
+    resulting screen contents. A thread owned by the library compares the copy to what it sent to
+    the terminal before, and writes the differences. Therefore ::t3_term_update returns quickly,
+    regardless of how fast the terminal accepts output. If a new frame is produced before the
+    previous one has been picked up by the writer thread, the previous frame is never sent.
+
+    While asynchronous output is enabled, the non-blocking output mode, typeahead checking and the
+    limits passed to ::t3_term_update_bounded have no effect, and ::t3_term_update_cursor sends a
+    complete frame. The writer thread is stopped by ::t3_term_restore, and started again by
+    ::t3_term_init.
+
+    Text with the ::T3_ATTR_USER attribute is drawn by the writer thread. This means that the
+    callback set with ::t3_term_set_user_callback is called on the writer thread, not on the thread
+    that called ::t3_term_update, and may run concurrently with the rest of the program. Any data it
+    shares with other threads must be protected by the program. The output buffer is owned by the
+    writer thread as well, so ::t3_term_putc, ::t3_term_puts, ::t3_term_putn, ::t3_term_reserve and
+    ::t3_term_commit may only be called from within that callback.
+*/
+t3_bool t3_term_set_async_output(t3_bool async) {
+  if (initialised && async != _t3_async_output) {
+    if (async) {
+      if (!_t3_start_async_output()) {
+        return t3_false;
+      }
+    } else {
+      _t3_stop_async_output();
+    }
+  }
+#ifndef HAS_PTHREAD
+  if (async) {
+    return t3_false;
+  }
+#endif
+  _t3_async_output = async;
+  return t3_true;
+}
+
 /** Free all memory allocated by libt3window.
 
     This function releases all memory allocated by libt3window, and allows
@@ -862,9 +1003,15 @@ void t3_term_restore(void) {
 */
 void t3_term_deinit(void) {
   t3_term_restore();
-  CLEAR(_t3_putp_file, fclose);
+  if (_t3_terminal_out_fd >= 0) {
+    close(_t3_terminal_out_fd);
+    _t3_terminal_out_fd = -1;
+  }
+  _t3_free_frame_buffer();
 
   seqs_initialised = t3_false;
+  _t3_output_driver = &_t3_terminfo_driver;
+  _t3_sync_output_supported = t3_false;
   CLEAR(smcup, free);
   CLEAR(rmcup, free);
   CLEAR(_t3_clear, free);
@@ -892,11 +1039,20 @@ void t3_term_deinit(void) {
   CLEAR(_t3_rc, free);
   CLEAR(_t3_civis, free);
   CLEAR(_t3_cnorm, free);
+  _t3_compile_cap(&_t3_cup_cap, NULL, 0);
+  _t3_compile_cap(&_t3_hpa_cap, NULL, 0);
+  _t3_compile_cap(&_t3_vpa_cap, NULL, 0);
+  _t3_compile_cap(&_t3_cud_cap, NULL, 0);
+  _t3_compile_cap(&_t3_cuf_cap, NULL, 0);
 
   CLEAR(_t3_terminal_window, t3_win_del);
   CLEAR(_t3_old_data.data, free);
+  _t3_free_line_boundaries();
+  _t3_free_priority_lines();
   _t3_free_output_buffer();
   _t3_free_attr_map();
+  _t3_free_cell_owners();
+  _t3_free_debug_repaint();
   if (transcript_init_done) {
     transcript_finalize();
     transcript_init_done = t3_false;
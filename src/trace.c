@@ -0,0 +1,235 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "trace.h"
+
+/* Each thread that records events gets its own ring of trace records, such that recording an
+   event never has to synchronize with other threads. When a ring is full, the oldest records are
+   overwritten. Rings are created the first time a thread records an event. When a thread exits,
+   its ring is kept, such that its records can still be dumped, but it is marked as free. The next
+   thread that starts recording events reuses it, so threads that are started repeatedly, like the
+   writer thread for asynchronous output, do not use more memory each time.
+
+   A dump starts with a header consisting of the magic string "T3TRACE", a 32-bit byte-order mark
+   0x01020304 and the 32-bit size of a record, all in native byte order. It is followed by the
+   contents of each ring, as a 32-bit thread number and a 32-bit record count, followed by the
+   records from oldest to newest. */
+
+#define TRACE_RING_SIZE 4096 /* Must be a power of two. */
+#define TRACE_MAGIC "T3TRACE"
+
+#ifdef HAS_PTHREAD
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
+typedef struct trace_ring_t trace_ring_t;
+struct trace_ring_t {
+  trace_ring_t *next;
+  /* Boolean indicating whether the ring belongs to a running thread. Protected by rings_lock. */
+  t3_bool in_use;
+  uint32_t thread;
+  /* Number of records written to this ring since its creation. Only the owning thread changes
+     this, but it is read by the thread dumping the ring. */
+  uint32_t head;
+  trace_record_t records[TRACE_RING_SIZE];
+};
+
+/** @internal Boolean indicating whether events should be recorded. */
+t3_bool _t3_trace_enabled;
+
+static THREAD_LOCAL trace_ring_t *thread_ring;
+static trace_ring_t *rings;
+static uint32_t next_thread;
+static mutex_t rings_lock = MUTEX_INITIALIZER;
+
+#ifdef HAS_PTHREAD
+/* Key used only to be notified when a thread that owns a ring exits. */
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/** Mark the ring of an exiting thread as free for reuse. */
+static void release_ring(void *data) {
+  trace_ring_t *ring = data;
+
+  MUTEX_LOCK(&rings_lock);
+  ring->in_use = t3_false;
+  MUTEX_UNLOCK(&rings_lock);
+}
+
+static void init_ring_key(void) { pthread_key_create(&ring_key, release_ring); }
+#endif
+
+/** Get a ring for the calling thread, either a ring released by an exited thread or a new one.
+
+    A reused ring is emptied, and gets a new thread number, such that the records of different
+    threads can be distinguished in the dump.
+*/
+static trace_ring_t *new_ring(void) {
+  trace_ring_t *ring;
+
+  MUTEX_LOCK(&rings_lock);
+  for (ring = rings; ring != NULL && ring->in_use; ring = ring->next) {
+  }
+  if (ring == NULL) {
+    if ((ring = calloc(1, sizeof(trace_ring_t))) == NULL) {
+      MUTEX_UNLOCK(&rings_lock);
+      return NULL;
+    }
+    ring->next = rings;
+    rings = ring;
+  }
+  ring->in_use = t3_true;
+  ring->thread = next_thread++;
+  ATOMIC_STORE(&ring->head, 0);
+  MUTEX_UNLOCK(&rings_lock);
+
+#ifdef HAS_PTHREAD
+  pthread_once(&ring_key_once, init_ring_key);
+  pthread_setspecific(ring_key, ring);
+#endif
+  return ring;
+}
+
+/** @internal
+    @brief Record an event in the trace ring of the calling thread.
+
+    This function should not be called directly, but through the @c TRACE macro, which only calls
+    it when tracing is enabled.
+*/
+void _t3_trace(int event, long arg0, long arg1, long arg2) {
+  trace_ring_t *ring = thread_ring;
+  trace_record_t *record;
+  uint32_t head;
+
+  if (ring == NULL) {
+    if ((ring = new_ring()) == NULL) {
+      return;
+    }
+    thread_ring = ring;
+  }
+
+  head = ring->head;
+  record = &ring->records[head & (TRACE_RING_SIZE - 1)];
+  record->time = (uint64_t)_t3_monotonic_usec();
+  record->event = (uint16_t)event;
+  record->thread = (uint16_t)ring->thread;
+  record->args[0] = (int32_t)arg0;
+  record->args[1] = (int32_t)arg1;
+  record->args[2] = (int32_t)arg2;
+  /* Publish the record only after it has been completely written. */
+  ATOMIC_STORE(&ring->head, head + 1);
+}
+
+/** Write all of @p data to @p fd, retrying after interrupts and partial writes. */
+static t3_bool write_all(int fd, const void *data, size_t n) {
+  const char *ptr = data;
+
+  while (n > 0) {
+    ssize_t retval = write(fd, ptr, n);
+    if (retval < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return t3_false;
+    }
+    ptr += retval;
+    n -= retval;
+  }
+  return t3_true;
+}
+
+/** Write the contents of a single ring to @p fd.
+    @param buffer Scratch space for a copy of the ring, large enough to hold ::TRACE_RING_SIZE
+        records.
+
+    The owning thread may continue recording events while the ring is copied. Records that may have
+    been overwritten during the copy are left out of the dump.
+*/
+static t3_bool dump_ring(int fd, const trace_ring_t *ring, trace_record_t *buffer) {
+  uint32_t head, end, start, i, header[2];
+
+  end = ATOMIC_LOAD(&ring->head);
+  start = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+  for (i = start; i != end; i++) {
+    buffer[i - start] = ring->records[i & (TRACE_RING_SIZE - 1)];
+  }
+  /* Any record that was reused since the copy started is unreliable. This includes the slot for
+     record number head, which may be in the process of being written. */
+  head = ATOMIC_LOAD(&ring->head) + 1;
+  if (head - start > TRACE_RING_SIZE) {
+    uint32_t skip = head - start - TRACE_RING_SIZE;
+    if (skip > end - start) {
+      skip = end - start;
+    }
+    buffer += skip;
+    start += skip;
+  }
+
+  header[0] = ring->thread;
+  header[1] = end - start;
+  return write_all(fd, header, sizeof(header)) &&
+         write_all(fd, buffer, (end - start) * sizeof(trace_record_t));
+}
+
+/** Enable or disable recording of trace events.
+    @param enable Boolean indicating whether events should be recorded.
+    @ingroup t3window_term
+
+    The library can record events, such as the start and end of terminal updates and the writes
+    to the terminal, in a fixed-size ring buffer per thread. Recording an event only takes a few
+    memory writes, so tracing can be left enabled in production builds. The recorded events can
+    be written to a file using ::t3_term_trace_dump, and decoded with the @c decode_trace.py script
+    included in the source distribution. Tracing can also be enabled by including @c trace=on in
+    the @c T3WINDOW_OPTS environment variable.
+*/
+void t3_term_set_trace(t3_bool enable) { ATOMIC_STORE(&_t3_trace_enabled, enable); }
+
+/** Write the recorded trace events to a file descriptor.
+    @param fd The file descriptor to write to.
+    @return A boolean indicating whether the dump was written successfully. On failure, @c errno
+        indicates the reason.
+    @ingroup t3window_term
+
+    Events are recorded only after enabling tracing with ::t3_term_set_trace. Only the most recent
+    events of each thread are retained. This function may be called from any thread, and does not
+    stop the recording of events.
+*/
+t3_bool t3_term_trace_dump(int fd) {
+  uint32_t header[2] = {0x01020304, sizeof(trace_record_t)};
+  trace_record_t *buffer;
+  trace_ring_t *ring;
+  t3_bool result;
+
+  if ((buffer = malloc(TRACE_RING_SIZE * sizeof(trace_record_t))) == NULL) {
+    return t3_false;
+  }
+
+  MUTEX_LOCK(&rings_lock);
+  result = write_all(fd, TRACE_MAGIC, sizeof(TRACE_MAGIC)) && write_all(fd, header, sizeof(header));
+  for (ring = rings; result && ring != NULL; ring = ring->next) {
+    result = dump_ring(fd, ring, buffer);
+  }
+  MUTEX_UNLOCK(&rings_lock);
+  free(buffer);
+  return result;
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2018 G.P. Halkes
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef T3_TRACE_H
+#define T3_TRACE_H
+
+#include <stdint.h>
+
+#include "lock.h"
+#include "window_api.h"
+
+/* Event identifiers stored in trace records. These values are part of the dump format, and are
+   decoded by decode_trace.py. Only ever append new events. The comments list the arguments. */
+enum {
+  TRACE_FRAME_BEGIN = 1,        /* - */
+  TRACE_FRAME_END = 2,          /* lines updated, bytes pending, complete */
+  TRACE_LINE_COMPOSITE = 3,     /* line, width */
+  TRACE_LINE_EMIT = 4,          /* line, bytes added to the frame buffer */
+  TRACE_WRITE = 5,              /* bytes requested, result, errno */
+  TRACE_INPUT_READ = 6,         /* result, character, errno */
+  TRACE_POSITION_REPORT = 7,    /* row, column, report number */
+  TRACE_MODE_REPORT = 8,        /* mode, value */
+  TRACE_SIZE_DETECTED = 9,      /* lines, columns */
+  TRACE_ASYNC_FRAME_BEGIN = 10, /* requests */
+  TRACE_ASYNC_FRAME_END = 11,   /* lines, bytes, result */
+};
+
+/* A single trace record. The layout is fixed, such that dumps can be decoded without knowing
+   anything about the program that produced them. */
+typedef struct {
+  uint64_t time; /* Microseconds, from _t3_monotonic_usec. */
+  uint16_t event;
+  uint16_t thread;
+  int32_t args[3];
+} trace_record_t;
+
+/* The check for tracing is inlined, such that disabled tracing only costs a load and a branch. */
+#define TRACE(_event, _a, _b, _c)            \
+  do {                                       \
+    if (ATOMIC_LOAD(&_t3_trace_enabled)) {   \
+      _t3_trace((_event), (_a), (_b), (_c)); \
+    }                                        \
+  } while (0)
+
+T3_WINDOW_LOCAL extern t3_bool _t3_trace_enabled;
+
+T3_WINDOW_LOCAL void _t3_trace(int event, long arg0, long arg1, long arg2);
+
+#endif
@@ -11,8 +11,20 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
+#ifdef HAS_AVX2_DISPATCH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "utf8.h"
-#include "generated/chardata.h"
+#include "char_info.h"
+#include "generated/grapheme_break.h"
+#include "generated/nfc_quick_check.h"
+#include "internal.h"
 
 /* Returns whether a codepoint is one of the conjoining Jamo L codepoints. */
 static t3_bool is_conjoining_jamo_l(uint32_t c) { return c >= 0x1100 && c <= 0x1112; }
@@ -137,6 +149,155 @@ uint32_t t3_utf8_get(const char *src, size_t *size) {
   return retval;
 }
 
+/* The functions below convert a run of ASCII bytes to codepoints, a vector at a time. They stop at
+   the first vector containing a byte with the high bit set, or when less than a full vector is
+   left, and return the number of bytes converted. The remainder is left to the scalar code in
+   decode_ascii. */
+#ifdef HAS_AVX2_DISPATCH
+/* Only called if the CPU supports AVX2, which is checked at run time. */
+__attribute__((target("avx2"))) static size_t decode_ascii_avx2(const uint8_t *src, size_t n,
+                                                                uint32_t *dst) {
+  size_t idx;
+
+  for (idx = 0; idx + 32 <= n; idx += 32) {
+    if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(src + idx))) != 0) {
+      break;
+    }
+    _mm256_storeu_si256((__m256i *)(dst + idx),
+                        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + idx))));
+    _mm256_storeu_si256((__m256i *)(dst + idx + 8),
+                        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + idx + 8))));
+    _mm256_storeu_si256((__m256i *)(dst + idx + 16),
+                        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + idx + 16))));
+    _mm256_storeu_si256((__m256i *)(dst + idx + 24),
+                        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + idx + 24))));
+  }
+  return idx;
+}
+#endif
+
+#if defined(__SSE2__)
+static size_t decode_ascii_vector(const uint8_t *src, size_t n, uint32_t *dst) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i bytes, low, high;
+  size_t idx;
+
+  for (idx = 0; idx + 16 <= n; idx += 16) {
+    bytes = _mm_loadu_si128((const __m128i *)(src + idx));
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    low = _mm_unpacklo_epi8(bytes, zero);
+    high = _mm_unpackhi_epi8(bytes, zero);
+    _mm_storeu_si128((__m128i *)(dst + idx), _mm_unpacklo_epi16(low, zero));
+    _mm_storeu_si128((__m128i *)(dst + idx + 4), _mm_unpackhi_epi16(low, zero));
+    _mm_storeu_si128((__m128i *)(dst + idx + 8), _mm_unpacklo_epi16(high, zero));
+    _mm_storeu_si128((__m128i *)(dst + idx + 12), _mm_unpackhi_epi16(high, zero));
+  }
+  return idx;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static size_t decode_ascii_vector(const uint8_t *src, size_t n, uint32_t *dst) {
+  uint8x16_t bytes;
+  uint16x8_t low, high;
+  size_t idx;
+
+  for (idx = 0; idx + 16 <= n; idx += 16) {
+    bytes = vld1q_u8(src + idx);
+    if (vmaxvq_u8(bytes) >= 0x80) {
+      break;
+    }
+    low = vmovl_u8(vget_low_u8(bytes));
+    high = vmovl_u8(vget_high_u8(bytes));
+    vst1q_u32(dst + idx, vmovl_u16(vget_low_u16(low)));
+    vst1q_u32(dst + idx + 4, vmovl_u16(vget_high_u16(low)));
+    vst1q_u32(dst + idx + 8, vmovl_u16(vget_low_u16(high)));
+    vst1q_u32(dst + idx + 12, vmovl_u16(vget_high_u16(high)));
+  }
+  return idx;
+}
+#else
+static size_t decode_ascii_vector(const uint8_t *src, size_t n, uint32_t *dst) {
+  (void)src;
+  (void)n;
+  (void)dst;
+  return 0;
+}
+#endif
+
+/** Convert the run of ASCII bytes at the start of @p src to codepoints.
+    @return The number of bytes converted, which is at most @p n.
+*/
+static size_t decode_ascii(const uint8_t *src, size_t n, uint32_t *dst) {
+  size_t idx;
+
+#ifdef HAS_AVX2_DISPATCH
+  if (__builtin_cpu_supports("avx2")) {
+    idx = decode_ascii_avx2(src, n, dst);
+  } else {
+    idx = decode_ascii_vector(src, n, dst);
+  }
+#else
+  idx = decode_ascii_vector(src, n, dst);
+#endif
+  for (; idx < n && src[idx] < 0x80; idx++) {
+    dst[idx] = src[idx];
+  }
+  return idx;
+}
+
+/** Decode a UTF-8 string into codepoints.
+    @param src The UTF-8 string to decode.
+    @param size The location of the number of bytes in @p src. On return, it holds the number of
+        bytes decoded.
+    @param dst The location to store the codepoints.
+    @param dst_size The maximum number of codepoints to store in @p dst.
+    @return The number of codepoints stored in @p dst.
+
+    The result is the same as calling ::t3_utf8_get repeatedly, including the replacement of
+    invalid sequences by @c FFFD. Decoding stops when all of @p src is decoded or @p dst is full,
+    so a string can be decoded in pieces by calling this function repeatedly with a fixed size
+    buffer. Runs of ASCII characters are decoded using vector instructions, if available.
+*/
+size_t t3_utf8_decode(const char *src, size_t *size, uint32_t *dst, size_t dst_size) {
+  const uint8_t *bytes = (const uint8_t *)src;
+  size_t n = *size, idx = 0, count = 0, codepoint_len, run;
+  uint32_t c;
+
+  while (idx < n && count < dst_size) {
+    if (bytes[idx] < 0x80) {
+      run = n - idx < dst_size - count ? n - idx : dst_size - count;
+      run = decode_ascii(bytes + idx, run, dst + count);
+      idx += run;
+      count += run;
+      continue;
+    }
+    /* Handle the most common well-formed sequences inline. Lead bytes C2 to DF always start a
+       sequence of at least 0x80, but three byte sequences may be overlong. */
+    if (bytes[idx] >= 0xC2 && bytes[idx] <= 0xDF && n - idx >= 2 &&
+        (bytes[idx + 1] & 0xC0) == 0x80) {
+      dst[count++] = ((uint32_t)(bytes[idx] & 0x1F) << 6) | (bytes[idx + 1] & 0x3F);
+      idx += 2;
+      continue;
+    }
+    if ((bytes[idx] & 0xF0) == 0xE0 && n - idx >= 3 && (bytes[idx + 1] & 0xC0) == 0x80 &&
+        (bytes[idx + 2] & 0xC0) == 0x80) {
+      c = ((uint32_t)(bytes[idx] & 0x0F) << 12) | ((uint32_t)(bytes[idx + 1] & 0x3F) << 6) |
+          (bytes[idx + 2] & 0x3F);
+      if (c >= 0x800) {
+        dst[count++] = c;
+        idx += 3;
+        continue;
+      }
+    }
+    codepoint_len = n - idx;
+    dst[count++] = t3_utf8_get(src + idx, &codepoint_len);
+    idx += codepoint_len;
+  }
+  *size = idx;
+  return count;
+}
+
 /** Convert a codepoint to a UTF-8 string.
     @param c The codepoint to convert.
     @param dst The location to store the result.
@@ -179,7 +340,7 @@ size_t t3_utf8_put(uint32_t c, char *dst) {
     it. This is mostly similar to the result of wcwidth, with the exception
     of some characters where terminals actually use a different value.
 */
-int t3_utf8_wcwidth(uint32_t c) { return (int)(get_chardata(c) >> 6) - 1; }
+int t3_utf8_wcwidth(uint32_t c) { return _t3_char_width(c); }
 
 typedef enum {
   JAMO_NONE,
@@ -212,3 +373,371 @@ int t3_utf8_wcwidth_ext(uint32_t c, int *state) {
     return t3_utf8_wcwidth(c);
   }
 }
+
+#define GCB_BIT(x) (1 << _T3_GCB_##x)
+/* Rules GB9 and GB9a: no break before extending characters, zero-width joiners and spacing
+   marks. */
+#define GCB_EXTENDERS (GCB_BIT(EXTEND) | GCB_BIT(ZWJ) | GCB_BIT(SPACINGMARK))
+
+/* For each grapheme break class, the set of classes of the next codepoint that continue the
+   grapheme cluster, following the rules in Unicode Standard Annex #29. Rules GB11, GB12 and GB13
+   depend on more than the previous codepoint, and are handled in _t3_grapheme_continues. The
+   rule for Indic conjuncts (GB9c) is not implemented. */
+static const uint16_t grapheme_continues[_T3_GCB_CLASSES] = {
+    [_T3_GCB_OTHER] = GCB_EXTENDERS,
+    /* GB3 and GB4. */
+    [_T3_GCB_CR] = GCB_BIT(LF),
+    [_T3_GCB_LF] = 0,
+    [_T3_GCB_CONTROL] = 0,
+    [_T3_GCB_EXTEND] = GCB_EXTENDERS,
+    [_T3_GCB_ZWJ] = GCB_EXTENDERS,
+    [_T3_GCB_REGIONAL_INDICATOR] = GCB_EXTENDERS,
+    /* GB9b and GB5. */
+    [_T3_GCB_PREPEND] =
+        ((1 << _T3_GCB_CLASSES) - 1) & ~(GCB_BIT(CR) | GCB_BIT(LF) | GCB_BIT(CONTROL)),
+    [_T3_GCB_SPACINGMARK] = GCB_EXTENDERS,
+    /* GB6, GB7 and GB8. */
+    [_T3_GCB_L] = GCB_EXTENDERS | GCB_BIT(L) | GCB_BIT(V) | GCB_BIT(LV) | GCB_BIT(LVT),
+    [_T3_GCB_V] = GCB_EXTENDERS | GCB_BIT(V) | GCB_BIT(T),
+    [_T3_GCB_T] = GCB_EXTENDERS | GCB_BIT(T),
+    [_T3_GCB_LV] = GCB_EXTENDERS | GCB_BIT(V) | GCB_BIT(T),
+    [_T3_GCB_LVT] = GCB_EXTENDERS | GCB_BIT(T),
+    [_T3_GCB_EXTENDED_PICTOGRAPHIC] = GCB_EXTENDERS,
+};
+
+/** @internal
+    @brief Start the grapheme cluster segmentation of a string.
+    @param state The segmentation state to initialize.
+    @param c The first codepoint of the string.
+*/
+void _t3_grapheme_start(grapheme_state_t *state, uint32_t c) {
+  state->prev_class = _t3_grapheme_break_class(c);
+  state->pictographic = state->prev_class == _T3_GCB_EXTENDED_PICTOGRAPHIC;
+  state->pictographic_zwj = t3_false;
+  state->regional_indicators = state->prev_class == _T3_GCB_REGIONAL_INDICATOR;
+}
+
+/** @internal
+    @brief Check whether a codepoint continues the current grapheme cluster.
+    @param state The segmentation state, which is updated for @p c.
+    @param c The next codepoint of the string.
+    @return Whether there is no cluster boundary before @p c. If there is, @p state is restarted
+        from @p c, which starts the next cluster.
+*/
+t3_bool _t3_grapheme_continues(grapheme_state_t *state, uint32_t c) {
+  int next_class = _t3_grapheme_break_class(c);
+
+  if (!(grapheme_continues[state->prev_class] & (1 << next_class)) &&
+      /* GB11: no break within emoji modifier sequences or emoji zwj sequences. */
+      !(state->prev_class == _T3_GCB_ZWJ && next_class == _T3_GCB_EXTENDED_PICTOGRAPHIC &&
+        state->pictographic_zwj) &&
+      /* GB12 and GB13: regional indicators form pairs. */
+      !(state->prev_class == _T3_GCB_REGIONAL_INDICATOR &&
+        next_class == _T3_GCB_REGIONAL_INDICATOR && (state->regional_indicators & 1))) {
+    _t3_grapheme_start(state, c);
+    return t3_false;
+  }
+
+  if (next_class == _T3_GCB_EXTENDED_PICTOGRAPHIC) {
+    state->pictographic = t3_true;
+  } else if (next_class == _T3_GCB_ZWJ) {
+    state->pictographic_zwj = state->pictographic;
+    state->pictographic = t3_false;
+  } else if (next_class != _T3_GCB_EXTEND) {
+    state->pictographic = t3_false;
+  }
+  state->regional_indicators =
+      next_class == _T3_GCB_REGIONAL_INDICATOR ? state->regional_indicators + 1 : 0;
+  state->prev_class = next_class;
+  return t3_true;
+}
+
+/** Get the length of the first grapheme cluster in a UTF-8 string.
+    @param src The UTF-8 string.
+    @param size The number of bytes in @p src.
+    @return The number of bytes in the first grapheme cluster of @p src, which is 0 only if @p size
+        is 0.
+
+    The boundaries of the grapheme clusters are determined using the rules for extended grapheme
+    clusters from Unicode Standard Annex #29 and the Unicode 16.0.0 data, except for the rule for
+    Indic conjuncts (GB9c). A string can be split into grapheme clusters by calling this function
+    repeatedly.
+*/
+size_t t3_utf8_grapheme_length(const char *src, size_t size) {
+  size_t idx, codepoint_len;
+  grapheme_state_t state;
+
+  if (size == 0) {
+    return 0;
+  }
+  /* No ASCII character is a prepended character, so two ASCII characters are always in separate
+     grapheme clusters, except for a carriage return followed by a line feed. */
+  if (!(src[0] & 0x80) && (size == 1 || !(src[1] & 0x80))) {
+    return size > 1 && src[0] == '\r' && src[1] == '\n' ? 2 : 1;
+  }
+
+  codepoint_len = size;
+  _t3_grapheme_start(&state, t3_utf8_get(src, &codepoint_len));
+  for (idx = codepoint_len; idx < size; idx += codepoint_len) {
+    codepoint_len = size - idx;
+    if (!_t3_grapheme_continues(&state, t3_utf8_get(src + idx, &codepoint_len))) {
+      break;
+    }
+  }
+  return idx;
+}
+
+/** @internal
+    @brief Get the number of ASCII bytes at the start of a string.
+    @param src The string to scan.
+    @param n The number of bytes in @p src.
+
+    The string is scanned a machine word at a time, as most output consists of ASCII only.
+*/
+size_t _t3_ascii_prefix_length(const char *src, size_t n) {
+  const uint64_t high_bits = UINT64_C(0x8080808080808080);
+  size_t idx = 0;
+  uint64_t word;
+
+  for (; idx + sizeof(word) <= n; idx += sizeof(word)) {
+    /* memcpy compiles to a single (unaligned) load. */
+    memcpy(&word, src + idx, sizeof(word));
+    if (word & high_bits) {
+      break;
+    }
+  }
+  while (idx < n && !(src[idx] & 0x80)) {
+    idx++;
+  }
+  return idx;
+}
+
+/** @internal
+    @brief Check whether a codepoint may be changed by, or affect its neighbours in, NFC
+        normalization.
+
+    Text that only consists of codepoints for which this function returns @c false is already in
+    NFC. The table used is generated by generate_nfc_quick_check.py.
+*/
+t3_bool _t3_nfc_unstable(uint32_t c) { return c >= 0x110000 || _t3_nfc_qc_unstable(c); }
+
+/* Ranges of codepoints of common scripts in which all characters have the same width. None of
+   these characters are conjoining Jamo V or T, so their width does not depend on the characters
+   preceding them. These ranges must agree with the data returned by _t3_char_width. */
+static const struct {
+  uint32_t first, last;
+  int width;
+} uniform_width_ranges[] = {
+    {0x0020, 0x007E, 1}, /* ASCII */
+    {0x00A0, 0x02FF, 1}, /* Latin-1 Supplement, Latin Extended-A and -B, IPA Extensions */
+    {0x0370, 0x0482, 1}, /* Greek and Cyrillic, without the combining marks */
+    {0x3041, 0x3096, 2}, /* Hiragana */
+    {0x4E00, 0x9FFF, 2}, /* CJK Unified Ideographs */
+    {0xAC00, 0xD7A3, 2}, /* Hangul Syllables */
+};
+#define UNIFORM_WIDTH_RANGES (sizeof(uniform_width_ranges) / sizeof(uniform_width_ranges[0]))
+
+/* The functions below are the vector kernels for _t3_utf8_width_prefix. ascii_width_vector counts
+   the printable characters in a run of ASCII bytes, a vector at a time, as long as all of them
+   fit in @p max_width. group_width returns the total width of four codepoints, or -1 if not all
+   of them are in uniform_width_ranges. */
+#if defined(__SSE2__)
+static size_t ascii_width_vector(const uint8_t *src, size_t n, size_t max_width, size_t *width) {
+  const __m128i before_printable = _mm_set1_epi8(0x1F), after_printable = _mm_set1_epi8(0x7F);
+  __m128i bytes;
+  size_t idx;
+
+  for (idx = 0; idx + 16 <= n && max_width - *width >= 16; idx += 16) {
+    bytes = _mm_loadu_si128((const __m128i *)(src + idx));
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    /* All bytes are below 0x80 here, so the signed comparisons give the right result. */
+    *width += __builtin_popcount(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpgt_epi8(bytes, before_printable), _mm_cmplt_epi8(bytes, after_printable))));
+  }
+  return idx;
+}
+
+static int group_width(const uint32_t *codepoints) {
+  __m128i c = _mm_loadu_si128((const __m128i *)codepoints);
+  __m128i narrow = _mm_setzero_si128(), wide = _mm_setzero_si128(), in_range;
+  int narrow_mask, wide_mask;
+  size_t i;
+
+  for (i = 0; i < UNIFORM_WIDTH_RANGES; i++) {
+    in_range = _mm_and_si128(_mm_cmpgt_epi32(c, _mm_set1_epi32(uniform_width_ranges[i].first - 1)),
+                             _mm_cmplt_epi32(c, _mm_set1_epi32(uniform_width_ranges[i].last + 1)));
+    if (uniform_width_ranges[i].width == 1) {
+      narrow = _mm_or_si128(narrow, in_range);
+    } else {
+      wide = _mm_or_si128(wide, in_range);
+    }
+  }
+  narrow_mask = _mm_movemask_ps(_mm_castsi128_ps(narrow));
+  wide_mask = _mm_movemask_ps(_mm_castsi128_ps(wide));
+  if ((narrow_mask | wide_mask) != 0xF) {
+    return -1;
+  }
+  return __builtin_popcount(narrow_mask) + 2 * __builtin_popcount(wide_mask);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static size_t ascii_width_vector(const uint8_t *src, size_t n, size_t max_width, size_t *width) {
+  uint8x16_t bytes, printable;
+  size_t idx;
+
+  for (idx = 0; idx + 16 <= n && max_width - *width >= 16; idx += 16) {
+    bytes = vld1q_u8(src + idx);
+    if (vmaxvq_u8(bytes) >= 0x80) {
+      break;
+    }
+    printable = vandq_u8(vcgeq_u8(bytes, vdupq_n_u8(0x20)), vcleq_u8(bytes, vdupq_n_u8(0x7E)));
+    *width += vaddvq_u8(vshrq_n_u8(printable, 7));
+  }
+  return idx;
+}
+
+static int group_width(const uint32_t *codepoints) {
+  uint32x4_t c = vld1q_u32(codepoints), narrow = vdupq_n_u32(0), wide = vdupq_n_u32(0), in_range;
+  size_t i;
+
+  for (i = 0; i < UNIFORM_WIDTH_RANGES; i++) {
+    in_range = vandq_u32(vcgeq_u32(c, vdupq_n_u32(uniform_width_ranges[i].first)),
+                         vcleq_u32(c, vdupq_n_u32(uniform_width_ranges[i].last)));
+    if (uniform_width_ranges[i].width == 1) {
+      narrow = vorrq_u32(narrow, in_range);
+    } else {
+      wide = vorrq_u32(wide, in_range);
+    }
+  }
+  if (vminvq_u32(vorrq_u32(narrow, wide)) == 0) {
+    return -1;
+  }
+  return vaddvq_u32(vshrq_n_u32(narrow, 31)) + 2 * vaddvq_u32(vshrq_n_u32(wide, 31));
+}
+#else
+static size_t ascii_width_vector(const uint8_t *src, size_t n, size_t max_width, size_t *width) {
+  (void)src;
+  (void)n;
+  (void)max_width;
+  (void)width;
+  return 0;
+}
+
+static int group_width(const uint32_t *codepoints) {
+  (void)codepoints;
+  return -1;
+}
+#endif
+
+/** Get the length of the longest run of ASCII bytes that fits in @p max_width columns.
+    @param src The string to scan.
+    @param n The length of @p src.
+    @param max_width The maximum width of the run.
+    @param width The location of the width of the text before @p src, which is updated to include
+        the width of the run.
+    @return The length of the run in bytes.
+*/
+static size_t ascii_width_prefix(const uint8_t *src, size_t n, size_t max_width, size_t *width) {
+  size_t idx = ascii_width_vector(src, n, max_width, width);
+
+  for (; idx < n && src[idx] < 0x80; idx++) {
+    if (src[idx] >= 0x20 && src[idx] < 0x7F) {
+      if (*width == max_width) {
+        break;
+      }
+      (*width)++;
+    }
+  }
+  return idx;
+}
+
+/** Get the total width of a number of codepoints.
+    @param codepoints The codepoints.
+    @param count The number of codepoints in @p codepoints.
+    @param width_state The conjoining Jamo state, as used by ::t3_utf8_wcwidth_ext.
+*/
+static size_t codepoints_width(const uint32_t *codepoints, size_t count, int *width_state) {
+  size_t idx = 0, total = 0;
+  int width;
+
+  while (idx < count) {
+    if (idx + 4 <= count && (width = group_width(codepoints + idx)) >= 0) {
+      total += width;
+      idx += 4;
+      /* Of the characters in uniform_width_ranges, only the Hangul syllables change the Jamo
+         state, and only depending on the character itself. */
+      *width_state = 0;
+      if (codepoints[idx - 1] >= 0xAC00) {
+        t3_utf8_wcwidth_ext(codepoints[idx - 1], width_state);
+      }
+      continue;
+    }
+    width = t3_utf8_wcwidth_ext(codepoints[idx], width_state);
+    if (width > 0) {
+      total += width;
+    }
+    idx++;
+  }
+  return total;
+}
+
+/** @internal
+    @brief Get the longest prefix of a string that fits in a number of columns.
+    @param str The UTF-8 string to measure.
+    @param n The length of @p str in bytes.
+    @param max_width The maximum width of the prefix.
+    @param width The location to store the width of the prefix.
+    @return The length of the prefix in bytes.
+
+    Characters without width directly following the prefix are included in the prefix. Runs of
+    ASCII characters are counted without decoding them. Other text is decoded in chunks, and the
+    widths of characters from common scripts are determined four at a time.
+*/
+size_t _t3_utf8_width_prefix(const char *str, size_t n, size_t max_width, size_t *width) {
+  const uint8_t *bytes = (const uint8_t *)str;
+  uint32_t codepoints[64], c;
+  size_t idx = 0, total = 0, decoded, count, chunk_width, codepoint_len;
+  int width_state = 0, chunk_start_state, char_width;
+
+  while (idx < n) {
+    if (bytes[idx] < 0x80) {
+      idx += ascii_width_prefix(bytes + idx, n - idx, max_width, &total);
+      width_state = 0;
+      if (idx < n && bytes[idx] < 0x80) {
+        /* The next printable character does not fit. */
+        break;
+      }
+      continue;
+    }
+
+    decoded = n - idx;
+    count = t3_utf8_decode(str + idx, &decoded, codepoints,
+                           sizeof(codepoints) / sizeof(codepoints[0]));
+    chunk_start_state = width_state;
+    chunk_width = codepoints_width(codepoints, count, &width_state);
+    if (chunk_width <= max_width - total) {
+      total += chunk_width;
+      idx += decoded;
+      continue;
+    }
+
+    /* The limit is reached somewhere in this chunk. Find the exact position. */
+    width_state = chunk_start_state;
+    for (;;) {
+      codepoint_len = n - idx;
+      c = t3_utf8_get(str + idx, &codepoint_len);
+      char_width = t3_utf8_wcwidth_ext(c, &width_state);
+      if (char_width > 0) {
+        if ((size_t)char_width > max_width - total) {
+          break;
+        }
+        total += char_width;
+      }
+      idx += codepoint_len;
+    }
+    break;
+  }
+  *width = total;
+  return idx;
+}
@@ -35,6 +35,17 @@ extern "C" {
 
 T3_WINDOW_API uint32_t t3_utf8_get(const char *src, size_t *size);
 T3_WINDOW_API size_t t3_utf8_put(uint32_t c, char *dst);
+T3_WINDOW_API size_t t3_utf8_decode(const char *src, size_t *size, uint32_t *dst,
+                                    size_t dst_size);
+/** Get the length of the first grapheme cluster in a UTF-8 string.
+
+    The cluster boundaries follow Unicode Standard Annex #29 using the Unicode 16.0.0 data, except
+    that the rule for Indic conjuncts (GB9c) is not implemented. The character widths used elsewhere
+    in the library, such as by ::t3_utf8_wcwidth, and the Unicode versions used for
+    ::t3_term_can_draw come from Unicode 10.0.0. For characters assigned after Unicode 10.0.0 the
+    cluster boundaries are therefore more accurate than the widths.
+*/
+T3_WINDOW_API size_t t3_utf8_grapheme_length(const char *src, size_t size);
 
 T3_WINDOW_API int t3_utf8_wcwidth(uint32_t c);
 
@@ -180,6 +180,7 @@ t3_window_t *t3_win_new_unbacked(t3_window_t *parent, int height, int width, int
   retval->restrictw = NULL;
   retval->depth = depth;
   retval->cached_pos_line = -1;
+  MUTEX_INIT(&retval->lock);
 
   insert_window(retval);
   return retval;
@@ -356,6 +357,7 @@ void t3_win_del(t3_window_t *win) {
     }
     free(win->lines);
   }
+  MUTEX_DESTROY(&win->lock);
   free(win);
 }
 
@@ -380,9 +382,12 @@ t3_bool t3_win_resize(t3_window_t *win, int height, int width) {
     return t3_true;
   }
 
+  /* The lines may be reallocated, so make sure no other thread is painting the window. */
+  MUTEX_LOCK(&win->lock);
   if (height > win->height) {
     void *result;
     if ((result = realloc(win->lines, height * sizeof(line_data_t))) == NULL) {
+      MUTEX_UNLOCK(&win->lock);
       return t3_false;
     }
     win->lines = result;
@@ -392,6 +397,7 @@ t3_bool t3_win_resize(t3_window_t *win, int height, int width) {
         for (i = win->height; i < height && win->lines[i].data != NULL; i++) {
           free(win->lines[i].data);
         }
+        MUTEX_UNLOCK(&win->lock);
         return t3_false;
       }
       win->lines[i].allocated = INITIAL_ALLOC;
@@ -420,6 +426,7 @@ t3_bool t3_win_resize(t3_window_t *win, int height, int width) {
 
   win->height = height;
   win->width = width;
+  MUTEX_UNLOCK(&win->lock);
   return t3_true;
 }
 
@@ -625,4 +632,189 @@ void t3_win_hide(t3_window_t *win) { win->shown = t3_false; }
 /** Returns whether the t3_window_t is visible. */
 t3_bool t3_win_is_shown(t3_window_t *win) { return win->shown; }
 
+/** Set whether the lines covered by a t3_window_t should be drawn first by bounded updates.
+    @param win The t3_window_t to set the priority for.
+    @param priority Boolean indicating whether the lines covered by @p win have priority.
+
+    See ::t3_term_update_bounded for details.
+*/
+void t3_win_set_priority(t3_window_t *win, t3_bool priority) { win->priority = priority; }
+
+/** Mark the lines covered by shown priority windows in a list of windows and their children. */
+static void mark_priority_lines(t3_window_t *ptr, char *lines, int nr_of_lines) {
+  for (; ptr != NULL; ptr = ptr->next) {
+    if (!ptr->shown) {
+      continue;
+    }
+    if (ptr->priority) {
+      int y = t3_win_get_abs_y(ptr);
+      int end = y + ptr->height;
+      if (y < 0) {
+        y = 0;
+      }
+      for (; y < end && y < nr_of_lines; y++) {
+        lines[y] = 1;
+      }
+    }
+    mark_priority_lines(ptr->head, lines, nr_of_lines);
+  }
+}
+
+/** @internal
+    @brief Mark the terminal lines covered by shown windows with priority.
+    @param lines An array with an element for each terminal line, which is set to 1 for each line
+        covered by a window with priority.
+    @param nr_of_lines The number of elements in @p lines.
+*/
+void _t3_win_mark_priority_lines(char *lines, int nr_of_lines) {
+  mark_priority_lines(_t3_head, lines, nr_of_lines);
+}
+
+/** Lock the contents of a t3_window_t, for painting it from a thread other than the main thread.
+    @param win The t3_window_t to lock.
+
+    By default, all functions of the library must be called from a single thread. The exception is
+    painting a window: a thread may paint into a window using the t3_win_add* functions,
+    ::t3_win_set_paint, ::t3_win_clrtoeol, ::t3_win_clrtobot and ::t3_win_box, while holding the
+    lock of that window. ::t3_term_update takes the locks of all windows while compositing the
+    terminal contents, so it never sees a partially painted window. Painting threads should hold
+    the lock for a complete update of the window contents, and release it as soon as possible.
+
+    All other operations on the window, such as moving, resizing, showing and deleting it, must
+    still be done from the main thread. A thread should not hold more than one window lock at a
+    time. The lock is not recursive, so functions that take window locks themselves must not be
+    called while holding a window lock: ::t3_win_resize takes the lock of the resized window, and
+    ::t3_term_update, ::t3_term_update_bounded and ::t3_term_update_cursor take the locks of all
+    windows. Calling any of these while holding a window lock deadlocks.
+
+    If the library was compiled without thread support, this function does nothing.
+*/
+void t3_win_lock(t3_window_t *win) { MUTEX_LOCK(&win->lock); }
+
+/** Unlock the contents of a t3_window_t, locked by ::t3_win_lock. */
+void t3_win_unlock(t3_window_t *win) { MUTEX_UNLOCK(&win->lock); }
+
+/** Get the number of bytes allocated for a t3_window_t.
+    @param win The t3_window_t to get the allocation size for.
+    @return The number of bytes allocated for the t3_window_t and its contents.
+
+    This is intended for finding windows which use an unexpected amount of memory. See also
+    ::t3_term_get_stats.
+*/
+size_t t3_win_get_allocated_bytes(const t3_window_t *win) {
+  size_t result = sizeof(t3_window_t);
+  int i;
+
+  if (win->lines != NULL) {
+    result += win->height * sizeof(line_data_t);
+    for (i = 0; i < win->height; i++) {
+      result += win->lines[i].allocated;
+    }
+  }
+  return result;
+}
+
+/** Lock or unlock a list of windows and their children. */
+static void lock_windows(t3_window_t *ptr, t3_bool lock) {
+  for (; ptr != NULL; ptr = ptr->next) {
+    if (lock) {
+      MUTEX_LOCK(&ptr->lock);
+    } else {
+      MUTEX_UNLOCK(&ptr->lock);
+    }
+    lock_windows(ptr->head, lock);
+  }
+}
+
+/** @internal
+    @brief Lock all windows, such that no other thread can paint while compositing. */
+void _t3_win_lock_all(void) { lock_windows(_t3_head, t3_true); }
+
+/** @internal
+    @brief Unlock all windows locked by ::_t3_win_lock_all. */
+void _t3_win_unlock_all(void) { lock_windows(_t3_head, t3_false); }
+
+/** @internal Boolean indicating whether the per-window performance counters are updated. */
+t3_bool _t3_win_stats_enabled;
+
+static t3_win_stats_callback_t stats_callback;
+static void *stats_callback_data;
+
+/** Add the counters of the current frame to the statistics for a list of windows and their
+    children. */
+static void end_frame_windows(t3_window_t *ptr) {
+  for (; ptr != NULL; ptr = ptr->next) {
+    ptr->stats.last_frame = ptr->frame_stats;
+    ptr->stats.totals.lines_composited += ptr->frame_stats.lines_composited;
+    ptr->stats.totals.blocks_copied += ptr->frame_stats.blocks_copied;
+    ptr->stats.totals.composite_nsec += ptr->frame_stats.composite_nsec;
+    ptr->stats.totals.output_bytes += ptr->frame_stats.output_bytes;
+    memset(&ptr->frame_stats, 0, sizeof(t3_win_frame_stats_t));
+    end_frame_windows(ptr->head);
+  }
+}
+
+/** Call the statistics callback for all windows in a list, and their children, that contributed
+    to the last frame. */
+static void report_windows(t3_window_t *ptr) {
+  for (; ptr != NULL; ptr = ptr->next) {
+    if (ptr->stats.last_frame.lines_composited != 0 || ptr->stats.last_frame.output_bytes != 0) {
+      stats_callback(ptr, &ptr->stats, stats_callback_data);
+    }
+    report_windows(ptr->head);
+  }
+}
+
+/** @internal
+    @brief Finish the per-window performance counters for a frame, and report them if requested.
+*/
+void _t3_win_stats_end_frame(void) {
+  if (!_t3_win_stats_enabled) {
+    return;
+  }
+  end_frame_windows(_t3_head);
+  if (stats_callback != NULL) {
+    report_windows(_t3_head);
+  }
+}
+
+/** Get the performance counters of a t3_window_t.
+    @param win The t3_window_t to get the counters for.
+    @param stats The location to store the counters.
+    @param version The version of the library the caller was compiled against.
+
+    This function should not be called directly, but through the ::t3_win_get_stats macro. The
+    counters are only updated after enabling them with ::t3_win_set_stats_collection. The
+    composite time and blocks copied count the work of combining the window with the other
+    windows into the terminal contents. The output bytes count the output generated for terminal
+    cells that show the window, including the attribute changes and cursor movements leading up to
+    them. Output generated by the asynchronous output mode (see ::t3_term_set_async_output) is not
+    attributed to windows.
+*/
+void t3_win_get_stats_internal(const t3_window_t *win, t3_win_stats_t *stats, int version) {
+  (void)version;
+  *stats = win->stats;
+}
+
+/** Enable or disable the collection of per-window performance counters.
+    @param enable Boolean indicating whether the counters should be updated.
+
+    Measuring the work per window requires reading the clock for each window on each terminal
+    line, which is why collection is disabled by default.
+*/
+void t3_win_set_stats_collection(t3_bool enable) { _t3_win_stats_enabled = enable; }
+
+/** Set a callback to receive the per-window performance counters after each frame.
+    @param callback The function to call, or @c NULL to remove the callback.
+    @param data A pointer passed unmodified to @p callback.
+
+    After each ::t3_term_update that emitted a frame, @p callback is called for every window that
+    contributed to the frame. Collection of the counters must be enabled with
+    ::t3_win_set_stats_collection. The callback must not create, delete or reparent windows.
+*/
+void t3_win_set_stats_callback(t3_win_stats_callback_t callback, void *data) {
+  stats_callback = callback;
+  stats_callback_data = data;
+}
+
 /** @} */
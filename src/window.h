@@ -57,6 +57,29 @@ enum t3_win_anchor_t {
 */
 typedef struct t3_window_t t3_window_t;
 
+/** Counters for the work done for a single window. See ::t3_win_get_stats.
+    @ingroup t3window_other
+*/
+typedef struct {
+  unsigned long lines_composited; /**< Terminal lines to which the window contributed. */
+  unsigned long blocks_copied;    /**< Character blocks copied to the terminal contents. */
+  unsigned long composite_nsec;   /**< Time spent compositing the window, in nanoseconds. */
+  unsigned long output_bytes;     /**< Bytes of output generated for cells showing the window. */
+} t3_win_frame_stats_t;
+
+/** Data structure to store the performance counters of a window.
+    @ingroup t3window_other
+*/
+typedef struct {
+  t3_win_frame_stats_t last_frame; /**< Counters for the last emitted frame. */
+  t3_win_frame_stats_t totals;     /**< Counters for all frames since collection was enabled. */
+} t3_win_stats_t;
+
+/** Callback type for reporting the performance counters of a window after each frame.
+    @ingroup t3window_other
+*/
+typedef void (*t3_win_stats_callback_t)(t3_window_t *win, const t3_win_stats_t *stats, void *data);
+
 T3_WINDOW_API t3_window_t *t3_win_new(t3_window_t *parent, int height, int width, int y, int x,
                                       int depth);
 T3_WINDOW_API t3_window_t *t3_win_new_unbacked(t3_window_t *parent, int height, int width, int y,
@@ -85,6 +108,24 @@ T3_WINDOW_API void t3_win_set_paint(t3_window_t *win, int y, int x);
 T3_WINDOW_API void t3_win_show(t3_window_t *win);
 T3_WINDOW_API void t3_win_hide(t3_window_t *win);
 T3_WINDOW_API t3_bool t3_win_is_shown(t3_window_t *win);
+T3_WINDOW_API void t3_win_set_priority(t3_window_t *win, t3_bool priority);
+T3_WINDOW_API void t3_win_lock(t3_window_t *win);
+T3_WINDOW_API void t3_win_unlock(t3_window_t *win);
+T3_WINDOW_API size_t t3_win_get_allocated_bytes(const t3_window_t *win);
+
+/** Get the performance counters of a t3_window_t.
+    @param win The t3_window_t to get the counters for.
+    @param stats The location to store the counters.
+    @ingroup t3window_win
+
+    This define calls ::t3_win_get_stats_internal with the correct version argument.
+*/
+#define t3_win_get_stats(win, stats) t3_win_get_stats_internal((win), (stats), T3_WINDOW_VERSION)
+
+T3_WINDOW_API void t3_win_get_stats_internal(const t3_window_t *win, t3_win_stats_t *stats,
+                                             int version);
+T3_WINDOW_API void t3_win_set_stats_collection(t3_bool enable);
+T3_WINDOW_API void t3_win_set_stats_callback(t3_win_stats_callback_t callback, void *data);
 
 T3_WINDOW_API int t3_win_addnstr(t3_window_t *win, const char *str, size_t n, t3_attr_t attr);
 T3_WINDOW_API int t3_win_addstr(t3_window_t *win, const char *str, t3_attr_t attr);
@@ -230,6 +271,11 @@ class T3_WINDOW_API window_t {
   void show() { t3_win_show(window_); }
   void hide() { t3_win_hide(window_); }
   bool is_shown() { return t3_win_is_shown(window_); }
+  void set_priority(bool priority) { t3_win_set_priority(window_, priority); }
+  void lock() { t3_win_lock(window_); }
+  void unlock() { t3_win_unlock(window_); }
+  size_t get_allocated_bytes() const { return t3_win_get_allocated_bytes(window_); }
+  void get_stats(t3_win_stats_t *stats) const { t3_win_get_stats(window_, stats); }
   int addnstr(const char *str, size_t size, t3_attr_t attr) {
     return t3_win_addnstr(window_, str, size, attr);
   }
@@ -15,20 +15,32 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <unictype.h>
+#include <uninorm.h>
 
+#include "char_info.h"
+#include "convert_output.h"
 #include "internal.h"
+#include "lock.h"
 #include "log.h"
+#include "stats.h"
+#include "trace.h"
 #include "utf8.h"
 #include "window.h"
 
 /** @internal
-    @brief The maximum size of a UTF-8 character in bytes. Used in ::t3_win_addnstr.
+    @brief The size of the text in blocks that ::add_block can build without allocating memory.
 */
-#define UTF8_MAX_BYTES 4
+#define BLOCK_TEXT_BUFFER_SIZE 64
 
 /* Attribute to index mapping. To make the mapping quick, a simple hash table
    with hash chaining is used.
+
+   Windows may be painted from several threads at once, so the mapping must be safe for concurrent
+   use. Looking up an attribute set that was mapped before, which is by far the most common case,
+   does not take a lock. This works because entries are never moved or changed once they have been
+   added: they are stored in chunks that are allocated as needed, instead of in a single array that
+   is reallocated. A new entry is only linked into the hash map after it has been initialized
+   completely. Adding entries is serialized using ::attr_map_lock.
 */
 
 typedef struct attr_map_t attr_map_t;
@@ -38,19 +50,24 @@ struct attr_map_t {
 };
 
 /** @internal
-    @brief The initial allocation for ::attr_map.
+    @brief The size of the first chunk of ::attr_map_chunks. Each next chunk is twice as big.
 */
 #define ATTR_MAP_START_SIZE 32
+/** @internal
+    @brief The maximum number of chunks in ::attr_map_chunks.
+*/
+#define ATTR_MAP_MAX_CHUNKS 24
 /** @internal
     @brief The size of the hash map used for ::t3_attr_t mapping.
 */
 #define ATTR_HASH_MAP_SIZE 337
 
-static attr_map_t *attr_map; /**< @internal @brief The map of indices to attribute sets. */
-static int attr_map_fill,    /**< @internal @brief The number of elements used in ::attr_map. */
-    attr_map_allocated; /**< @internal @brief The number of elements allocated in ::attr_map. */
+static attr_map_t *attr_map_chunks[ATTR_MAP_MAX_CHUNKS]; /**< @internal @brief The chunks of the
+                                                            map of indices to attribute sets. */
+static int attr_map_fill; /**< @internal @brief The number of entries used in ::attr_map_chunks. */
 static int attr_hash_map[ATTR_HASH_MAP_SIZE]; /**< @internal @brief Hash map for quickly mapping
                                                  ::t3_attr_t's to indices. */
+static mutex_t attr_map_lock = MUTEX_INITIALIZER; /**< @internal @brief Lock for adding entries. */
 
 /** @addtogroup t3window_win */
 /** @{ */
@@ -94,35 +111,89 @@ static t3_bool ensure_space(line_data_t *line, size_t n) {
 }
 
 /** @internal
-    @brief Map a set of attributes to an integer.
-    @param attr The attribute set to map.
+    @brief Get the number of attribute sets in the attribute map. */
+size_t _t3_attr_map_size(void) { return ATOMIC_LOAD(&attr_map_fill); }
+
+/** Get the number of the chunk in ::attr_map_chunks which holds the entry at index @p idx. */
+static int get_attr_map_chunk(int idx) {
+  unsigned int pos = (unsigned int)idx + ATTR_MAP_START_SIZE;
+  int chunk = 0;
+
+  /* Chunk n contains the entries from ATTR_MAP_START_SIZE * (2^n - 1) up to
+     ATTR_MAP_START_SIZE * (2^(n + 1) - 1). */
+  while (pos >= (2u * ATTR_MAP_START_SIZE) << chunk) {
+    chunk++;
+  }
+  return chunk;
+}
+
+/** Get the entry at index @p idx in the attribute map. */
+static attr_map_t *get_attr_map_entry(int idx) {
+  int chunk = get_attr_map_chunk(idx);
+  return &attr_map_chunks[chunk][idx + ATTR_MAP_START_SIZE - (ATTR_MAP_START_SIZE << chunk)];
+}
+
+/** Find the index of an attribute set which was previously added to the attribute map.
+    @return The index of @p attr, or -1 if it has not been added.
 */
-int _t3_map_attr(t3_attr_t attr) {
+static int find_attr(t3_attr_t attr) {
   int ptr;
 
-  for (ptr = attr_hash_map[attr % ATTR_HASH_MAP_SIZE]; ptr != -1 && attr_map[ptr].attr != attr;
-       ptr = attr_map[ptr].next) {
+  for (ptr = ATOMIC_LOAD(&attr_hash_map[attr % ATTR_HASH_MAP_SIZE]); ptr != -1;) {
+    attr_map_t *entry = get_attr_map_entry(ptr);
+    if (entry->attr == attr) {
+      return ptr;
+    }
+    ptr = entry->next;
   }
+  return -1;
+}
 
-  if (ptr != -1) {
-    return ptr;
+/** Add an attribute set to the attribute map. Must be called with ::attr_map_lock held.
+    @return The index of @p attr, or -1 if no memory could be allocated.
+*/
+static int add_attr(t3_attr_t attr) {
+  int chunk = get_attr_map_chunk(attr_map_fill);
+  attr_map_t *entry;
+
+  if (chunk >= ATTR_MAP_MAX_CHUNKS) {
+    return -1;
+  }
+  if (attr_map_chunks[chunk] == NULL &&
+      (attr_map_chunks[chunk] = malloc((ATTR_MAP_START_SIZE << chunk) * sizeof(attr_map_t))) ==
+          NULL) {
+    return -1;
   }
 
-  if (attr_map_fill >= attr_map_allocated) {
-    int new_allocation = attr_map_allocated == 0 ? ATTR_MAP_START_SIZE : attr_map_allocated * 2;
-    attr_map_t *new_map;
+  entry = get_attr_map_entry(attr_map_fill);
+  entry->attr = attr;
+  entry->next = attr_hash_map[attr % ATTR_HASH_MAP_SIZE];
+  /* Only make the entry visible to other threads once it is complete. */
+  ATOMIC_STORE(&attr_map_fill, attr_map_fill + 1);
+  ATOMIC_STORE(&attr_hash_map[attr % ATTR_HASH_MAP_SIZE], attr_map_fill - 1);
+  return attr_map_fill - 1;
+}
 
-    if ((new_map = realloc(attr_map, new_allocation * sizeof(attr_map_t))) == NULL) {
-      return -1;
-    }
-    attr_map = new_map;
-    attr_map_allocated = new_allocation;
+/** @internal
+    @brief Map a set of attributes to an integer.
+    @param attr The attribute set to map.
+
+    This function may be called from any thread.
+*/
+int _t3_map_attr(t3_attr_t attr) {
+  int ptr;
+
+  if ((ptr = find_attr(attr)) != -1) {
+    return ptr;
   }
-  attr_map[attr_map_fill].attr = attr;
-  attr_map[attr_map_fill].next = attr_hash_map[attr % ATTR_HASH_MAP_SIZE];
-  attr_hash_map[attr % ATTR_HASH_MAP_SIZE] = attr_map_fill;
 
-  return attr_map_fill++;
+  MUTEX_LOCK(&attr_map_lock);
+  /* Another thread may have added the same attribute set in the mean time. */
+  if ((ptr = find_attr(attr)) == -1) {
+    ptr = add_attr(attr);
+  }
+  MUTEX_UNLOCK(&attr_map_lock);
+  return ptr;
 }
 
 /** @internal
@@ -130,10 +201,10 @@ int _t3_map_attr(t3_attr_t attr) {
     @param idx The mapped attribute index as returned by ::_t3_map_attr.
 */
 t3_attr_t _t3_get_attr(int idx) {
-  if (idx < 0 || idx > attr_map_fill) {
+  if (idx < 0 || idx >= ATOMIC_LOAD(&attr_map_fill)) {
     return 0;
   }
-  return attr_map[idx].attr;
+  return get_attr_map_entry(idx)->attr;
 }
 
 /** @internal
@@ -150,13 +221,14 @@ void _t3_init_attr_map(void) {
     @brief Clean up the memory used for attribute set mappings.
 */
 void _t3_free_attr_map(void) {
+  int chunk;
 #ifdef _T3_WINDOW_DEBUG
   {
     int ptr, chain, avg = 0, max = 0, chains = 0;
     int chain_length = 0;
     for (chain = 0; chain < ATTR_HASH_MAP_SIZE; chain++) {
       for (ptr = attr_hash_map[chain], chain_length = 0; ptr != -1;
-           ptr = attr_map[ptr].next, chain_length++) {
+           ptr = get_attr_map_entry(ptr)->next, chain_length++) {
       }
       if (chain_length > max) max = chain_length;
       if (chain_length > 0) {
@@ -168,9 +240,10 @@ void _t3_free_attr_map(void) {
             attr_map_fill);
   }
 #endif
-  free(attr_map);
-  attr_map = NULL;
-  attr_map_allocated = 0;
+  for (chunk = 0; chunk < ATTR_MAP_MAX_CHUNKS; chunk++) {
+    free(attr_map_chunks[chunk]);
+    attr_map_chunks[chunk] = NULL;
+  }
   attr_map_fill = 0;
   _t3_init_attr_map();
 }
@@ -460,7 +533,7 @@ size_t _t3_put_value(uint32_t c, char *dst) {
 */
 static size_t create_space_block(int attr, char *out) {
   size_t result_size;
-  result_size = _t3_put_value(attr, out + 1);
+  result_size = _t3_put_value(attr << 1, out + 1);
   result_size++;
   out[result_size] = ' ';
   out[0] = result_size << 1;
@@ -474,9 +547,59 @@ static uint32_t get_block_attr(const char *block) {
   for (block++; ((*block) & 0xc0) == 0x80; block++) {
   }
 
-  return _t3_get_value(block, &discard);
+  return _T3_BLOCK_ATTR_TO_INDEX(_t3_get_value(block, &discard));
+}
+
+/** Set or clear the ::_T3_BLOCK_ATTR_FILTER flag of a block, depending on the text it contains.
+
+    Changing the lowest bit does not change the number of bytes needed to store the value, so the
+    attribute value can be overwritten in place.
+*/
+static void update_block_filter_flag(char *block) {
+  uint32_t block_size, attr_value, new_attr_value;
+  size_t block_size_bytes, attr_bytes;
+
+  block_size = _t3_get_value(block, &block_size_bytes);
+  block += block_size_bytes;
+  attr_value = _t3_get_value(block, &attr_bytes);
+  new_attr_value = attr_value & ~(uint32_t)_T3_BLOCK_ATTR_FILTER;
+  if (_t3_output_needs_filter(block + attr_bytes, (block_size >> 1) - attr_bytes)) {
+    new_attr_value |= _T3_BLOCK_ATTR_FILTER;
+  }
+  if (new_attr_value != attr_value) {
+    _t3_put_value(new_attr_value, block);
+  }
 }
 
+/** Recompute the ::_T3_BLOCK_ATTR_FILTER flags of all blocks in a list of windows and their
+    children. */
+static void update_windows_filter_flags(t3_window_t *win) {
+  uint32_t block_size;
+  size_t block_size_bytes;
+  int i, j;
+
+  for (; win != NULL; win = win->next) {
+    MUTEX_LOCK(&win->lock);
+    /* Unbacked windows do not have any data. */
+    for (i = 0; win->lines != NULL && i < win->height; i++) {
+      for (j = 0; j < win->lines[i].length; j += (block_size >> 1) + block_size_bytes) {
+        block_size = _t3_get_value(win->lines[i].data + j, &block_size_bytes);
+        update_block_filter_flag(win->lines[i].data + j);
+      }
+    }
+    MUTEX_UNLOCK(&win->lock);
+    update_windows_filter_flags(win->head);
+  }
+}
+
+/** @internal
+    @brief Recompute the flags indicating which blocks must be filtered on output.
+
+    Must be called when the detected terminal capabilities change. Takes the lock of each window
+    while updating its contents.
+*/
+void _t3_win_update_filter_flags(void) { update_windows_filter_flags(_t3_head); }
+
 /** Insert a zero-width character into an existing block.
     @param win The window to write to.
     @param str The string containing the UTF-8 encoded zero-width character.
@@ -554,6 +677,7 @@ static t3_bool _win_add_zerowidth(t3_window_t *win, const char *str, size_t n) {
 
   /* Move the data after the insertion point up by the size of the character
      string to insert and the difference in block size header size. */
+  STATS_ADD(memmove_bytes, win->lines[win->paint_y].length - i - block_size - block_size_bytes);
   memmove(win->lines[win->paint_y].data + i + new_block_size + new_block_size_bytes,
           win->lines[win->paint_y].data + i + block_size + block_size_bytes,
           win->lines[win->paint_y].length - i - block_size - block_size_bytes);
@@ -561,11 +685,13 @@ static t3_bool _win_add_zerowidth(t3_window_t *win, const char *str, size_t n) {
   memcpy(win->lines[win->paint_y].data + i + block_size + block_size_bytes, str, n);
   /* If applicable, move the data for this block by the difference in block size header size. */
   if (new_block_size_bytes != block_size_bytes) {
+    STATS_ADD(memmove_bytes, new_block_size);
     memmove(win->lines[win->paint_y].data + i + new_block_size_bytes,
             win->lines[win->paint_y].data + i + block_size_bytes, new_block_size);
   }
   /* Copy in the new block size header. */
   memcpy(win->lines[win->paint_y].data + i, new_block_size_str, new_block_size_bytes);
+  update_block_filter_flag(win->lines[win->paint_y].data + i);
 
   win->lines[win->paint_y].length += n + (new_block_size_bytes - block_size_bytes);
   return t3_true;
@@ -587,6 +713,7 @@ static t3_bool _win_write_blocks(t3_window_t *win, const char *blocks, size_t n)
   uint32_t extra_spaces_attr;
   t3_bool result = t3_true;
 
+  STATS_ADD(write_blocks_calls, 1);
   if (win->lines == NULL) {
     return t3_false;
   }
@@ -657,6 +784,7 @@ static t3_bool _win_write_blocks(t3_window_t *win, const char *blocks, size_t n)
     if (!ensure_space(win->lines + win->paint_y, n + diff * default_attr_size)) {
       return t3_false;
     }
+    STATS_ADD(memmove_bytes, win->lines[win->paint_y].length);
     memmove(win->lines[win->paint_y].data + n + diff * default_attr_size,
             win->lines[win->paint_y].data, win->lines[win->paint_y].length);
     memcpy(win->lines[win->paint_y].data, blocks, n);
@@ -745,6 +873,7 @@ static t3_bool _win_write_blocks(t3_window_t *win, const char *blocks, size_t n)
       return t3_false;
     }
 
+    STATS_ADD(memmove_bytes, win->lines[win->paint_y].length - end_replace);
     memmove(win->lines[win->paint_y].data + end_replace + sdiff,
             win->lines[win->paint_y].data + end_replace,
             win->lines[win->paint_y].length - end_replace);
@@ -787,31 +916,93 @@ static t3_bool _win_write_blocks(t3_window_t *win, const char *blocks, size_t n)
   return result;
 }
 
-/** Add a string with explicitly specified size to a t3_window_t with specified attributes.
-    @param win The t3_window_t to add the string to.
-    @param str The string to add.
-    @param n The size of @p str.
-    @param attrs The attributes to use.
-    @retval ::T3_ERR_SUCCESS on succes
-    @retval ::T3_ERR_NONPRINT if a control character was encountered.
-    @retval ::T3_ERR_ERRNO otherwise.
+/** Normalize a string to NFC, unless it is already known to be normalized.
+    @param str The string to normalize.
+    @param n The length of @p str, which is updated to the length of the result.
+    @param buffer A buffer to hold the result if it fits.
+    @param buffer_size The size of @p buffer.
+    @return @p str if it does not change under normalization or is not valid UTF-8, @p buffer, or a
+        newly allocated string.
+*/
+static const char *normalize_str(const char *str, size_t *n, char *buffer, size_t buffer_size) {
+  size_t idx = 0, codepoint_len, result_len;
+  uint8_t *result;
+
+  while (idx < *n) {
+    idx += _t3_ascii_prefix_length(str + idx, *n - idx);
+    if (idx == *n) {
+      return str;
+    }
+    codepoint_len = *n - idx;
+    if (_t3_nfc_unstable(t3_utf8_get(str + idx, &codepoint_len))) {
+      break;
+    }
+    idx += codepoint_len;
+  }
+  if (idx >= *n) {
+    return str;
+  }
 
-    The default attributes are combined with the specified attributes, with
-    @p attr used as the priority attributes. All other t3_win_add* functions are
-    (indirectly) implemented using this function.
+  result_len = buffer_size;
+  result = u8_normalize(UNINORM_NFC, (const uint8_t *)str, *n, (uint8_t *)buffer, &result_len);
+  if (result == NULL) {
+    return str;
+  }
+  *n = result_len;
+  return (const char *)result;
+}
 
-    It is important that combining characters are provided in the same string as the
-    characters they are to combine with. In particular, this function does not check for
-    conjoining Jamo in the existing window data and explicitly prevents joining.
+/** Write a block holding a character and the zero-width characters following it to a window.
+    @param win The window to write to.
+    @param attrs_idx The index of the attributes to use.
+    @param str The text of the block.
+    @param n The number of bytes in @p str.
+    @param width The width of the block.
+    @return A boolean indicating success.
 */
-int t3_win_addnstr(t3_window_t *win, const char *str, size_t n, t3_attr_t attrs) {
-  size_t bytes_read;
-  char block[1 + 6 + UTF8_MAX_BYTES];
+static t3_bool add_block(t3_window_t *win, int attrs_idx, const char *str, size_t n, int width) {
+  /* The block starts with its size and the attribute index, each of which takes at most 6
+     bytes. */
+  char block_buffer[2 * 6 + BLOCK_TEXT_BUFFER_SIZE], attrs_str[6];
+  char *block = block_buffer;
+  size_t attrs_bytes, size_bytes;
+  t3_bool result;
+
+  if (n > BLOCK_TEXT_BUFFER_SIZE && (block = malloc(2 * 6 + n)) == NULL) {
+    return t3_false;
+  }
+
+  attrs_bytes = _t3_put_value(
+      (attrs_idx << 1) | (_t3_output_needs_filter(str, n) ? _T3_BLOCK_ATTR_FILTER : 0), attrs_str);
+  size_bytes = _t3_put_value(((attrs_bytes + n) << 1) + (width == 2 ? 1 : 0), block);
+  memcpy(block + size_bytes, attrs_str, attrs_bytes);
+  memcpy(block + size_bytes + attrs_bytes, str, n);
+
+  result = _win_write_blocks(win, block, size_bytes + attrs_bytes + n);
+  if (block != block_buffer) {
+    free(block);
+  }
+  return result;
+}
+
+/** Add a string in NFC to a t3_window_t, see ::t3_win_addnstr.
+
+    The string is split into grapheme clusters, and each cluster is written as a single block. As
+    a block is at most two cells wide, a cluster that consists of several characters with a
+    non-zero width, such as a sequence of emoji, is split into several blocks. Each of these
+    blocks holds one such character and the zero-width characters following it.
+*/
+static int add_normalized_str(t3_window_t *win, const char *str, size_t n, t3_attr_t attrs) {
+  size_t bytes_read, idx;
+  grapheme_state_t grapheme_state;
+  /* The block that is being built, which is part of the current grapheme cluster. */
+  const char *block_str = NULL;
+  size_t block_bytes = 0;
+  int block_width = 0;
   uint32_t c;
   int retval = T3_ERR_SUCCESS;
   int width;
   int attrs_idx;
-  size_t block_bytes;
 
   attrs = _t3_term_sanitize_attrs(attrs);
 
@@ -826,39 +1017,55 @@ int t3_win_addnstr(t3_window_t *win, const char *str, size_t n, t3_attr_t attrs)
   }
 
   int width_state = 0;
-  for (; n > 0; n -= bytes_read, str += bytes_read) {
-    bytes_read = n;
-    c = t3_utf8_get(str, &bytes_read);
-
-    int old_width_state = width_state;
-    width = t3_utf8_wcwidth_ext(c, &width_state);
-    if (old_width_state != 0 && width_state == 0) {
-      /* Ending a block with a conjoining Jamo character can cause problems when the
-         succeeding cell later is overwritten with a joining character. To prevent this
-         issue, insert a zero-with non-joiner. */
-      if (width_state != 0) {
-        _win_add_zerowidth(win, "\xE2\x80\x8C", 3);
+  /* Each codepoint is decoded once, and fed to both the grapheme cluster segmentation and the
+     width computation. */
+  for (idx = 0; idx < n; idx += bytes_read) {
+    bytes_read = n - idx;
+    c = t3_utf8_get(str + idx, &bytes_read);
+
+    if (idx == 0) {
+      _t3_grapheme_start(&grapheme_state, c);
+    } else if (!_t3_grapheme_continues(&grapheme_state, c) && block_width != 0) {
+      /* A block never extends beyond the end of a grapheme cluster. */
+      if (!add_block(win, attrs_idx, block_str, block_bytes, block_width)) {
+        return T3_ERR_ERRNO;
       }
+      block_width = 0;
     }
+
+    width = t3_utf8_wcwidth_ext(c, &width_state);
     /* UC_CATEGORY_MASK_Cn is for unassigned/reserved code points. These are
        not necessarily unprintable. */
-    if (width < 0 || uc_is_general_category_withtable(c, T3_UTF8_CONTROL_MASK)) {
+    if (width < 0 || _t3_char_is_control(c)) {
       retval = T3_ERR_NONPRINT;
+      /* The text of a block must be contiguous, so the characters following this one can not
+         be added to the current block anymore. */
+      if (block_width != 0) {
+        if (!add_block(win, attrs_idx, block_str, block_bytes, block_width)) {
+          return T3_ERR_ERRNO;
+        }
+        block_width = 0;
+      }
       continue;
     } else if (width == 0) {
-      _win_add_zerowidth(win, str, bytes_read);
+      if (block_width != 0) {
+        block_bytes += bytes_read;
+      } else {
+        _win_add_zerowidth(win, str + idx, bytes_read);
+      }
       continue;
     }
 
-    block_bytes = _t3_put_value(attrs_idx, block + 1);
-    memcpy(block + 1 + block_bytes, str, bytes_read);
-    block_bytes += bytes_read;
-    _t3_put_value((block_bytes << 1) + (width == 2 ? 1 : 0), block);
-    block_bytes++;
-
-    if (!_win_write_blocks(win, block, block_bytes)) {
+    if (block_width != 0 && !add_block(win, attrs_idx, block_str, block_bytes, block_width)) {
       return T3_ERR_ERRNO;
     }
+    block_str = str + idx;
+    block_bytes = bytes_read;
+    block_width = width;
+  }
+
+  if (block_width != 0 && !add_block(win, attrs_idx, block_str, block_bytes, block_width)) {
+    return T3_ERR_ERRNO;
   }
   /* Ending a block with a conjoining Jamo character can cause problems when the
      succeeding cell later is overwritten with a joining character. To prevent this
@@ -869,6 +1076,37 @@ int t3_win_addnstr(t3_window_t *win, const char *str, size_t n, t3_attr_t attrs)
   return retval;
 }
 
+/** Add a string with explicitly specified size to a t3_window_t with specified attributes.
+    @param win The t3_window_t to add the string to.
+    @param str The string to add.
+    @param n The size of @p str.
+    @param attrs The attributes to use.
+    @retval ::T3_ERR_SUCCESS on succes
+    @retval ::T3_ERR_NONPRINT if a control character was encountered.
+    @retval ::T3_ERR_ERRNO otherwise.
+
+    The default attributes are combined with the specified attributes, with
+    @p attr used as the priority attributes. All other t3_win_add* functions are
+    (indirectly) implemented using this function.
+
+    It is important that combining characters are provided in the same string as the
+    characters they are to combine with. In particular, this function does not check for
+    conjoining Jamo in the existing window data and explicitly prevents joining.
+
+    Text is stored in Normalization Form C (NFC), such that it does not have to be normalized each
+    time it is sent to the terminal.
+*/
+int t3_win_addnstr(t3_window_t *win, const char *str, size_t n, t3_attr_t attrs) {
+  char buffer[256];
+  const char *nfc_str = normalize_str(str, &n, buffer, sizeof(buffer));
+  int retval = add_normalized_str(win, nfc_str, n, attrs);
+
+  if (nfc_str != str && nfc_str != buffer) {
+    free((char *)nfc_str);
+  }
+  return retval;
+}
+
 /** Add a nul-terminated string to a t3_window_t with specified attributes.
     @param win The t3_window_t to add the string to.
     @param str The nul-terminated string to add.
@@ -966,11 +1204,82 @@ static t3_window_t *get_previous_window(t3_window_t *ptr) {
   return NULL;
 }
 
+/* For attributing output to windows, the window that provided the contents of each terminal cell
+   is recorded while compositing. This is only done while per-window statistics are collected. */
+static t3_window_t **cell_owners;
+static int cell_owners_lines, cell_owners_width;
+/* The window currently being composited, or NULL for the terminal background. */
+static t3_window_t *painting_owner;
+
+/** Make sure the cell owner array matches the size of the terminal. */
+static t3_bool ensure_cell_owners(void) {
+  t3_window_t **new_owners;
+
+  if (cell_owners != NULL && cell_owners_lines == _t3_terminal_window->height &&
+      cell_owners_width == _t3_terminal_window->width) {
+    return t3_true;
+  }
+
+  if ((new_owners = realloc(cell_owners, (size_t)_t3_terminal_window->height *
+                                             _t3_terminal_window->width *
+                                             sizeof(t3_window_t *))) == NULL) {
+    _t3_free_cell_owners();
+    return t3_false;
+  }
+  cell_owners = new_owners;
+  cell_owners_lines = _t3_terminal_window->height;
+  cell_owners_width = _t3_terminal_window->width;
+  return t3_true;
+}
+
+/** Record ::painting_owner as the owner of the cells [@p start, @p end) on the current line. */
+static void set_cell_owners(int start, int end) {
+  t3_window_t **owners;
+
+  if (!_t3_win_stats_enabled || cell_owners == NULL ||
+      _t3_terminal_window->paint_y >= cell_owners_lines) {
+    return;
+  }
+  if (end > cell_owners_width) {
+    end = cell_owners_width;
+  }
+  owners = cell_owners + (size_t)_t3_terminal_window->paint_y * cell_owners_width;
+  for (; start < end; start++) {
+    owners[start] = painting_owner;
+  }
+}
+
+/** @internal
+    @brief Get the t3_window_t that provided the contents of a terminal cell in the last composite.
+    @return The t3_window_t, or @c NULL if the cell shows the terminal background or the owner is
+        not known.
+
+    Owners are only recorded while per-window statistics are collected.
+*/
+t3_window_t *_t3_win_get_cell_owner(int line, int x) {
+  if (cell_owners == NULL || line < 0 || line >= cell_owners_lines || x < 0 ||
+      x >= cell_owners_width) {
+    return NULL;
+  }
+  return cell_owners[(size_t)line * cell_owners_width + x];
+}
+
+/** @internal
+    @brief Free the memory used for recording the owners of terminal cells.
+*/
+void _t3_free_cell_owners(void) {
+  free(cell_owners);
+  cell_owners = NULL;
+  cell_owners_lines = 0;
+  cell_owners_width = 0;
+}
+
 static t3_bool write_spaces_to_terminal_window(int attr_idx, int count) {
   char space_str[64];
   size_t space_str_bytes;
   int i;
   t3_bool result = true;
+  int start = _t3_terminal_window->paint_x;
 
   space_str_bytes = create_space_block(attr_idx, space_str);
   if (count > 1) {
@@ -987,6 +1296,7 @@ static t3_bool write_spaces_to_terminal_window(int attr_idx, int count) {
     result &= _win_write_blocks(_t3_terminal_window, space_str, space_str_bytes * 8);
   }
   result &= _win_write_blocks(_t3_terminal_window, space_str, space_str_bytes * (count & 7));
+  set_cell_owners(start, _t3_terminal_window->paint_x);
   return result;
 }
 
@@ -1000,16 +1310,23 @@ t3_bool _t3_win_refresh_term_line(int line) {
   line_data_t *draw;
   t3_window_t *ptr;
   int y, x, parent_y, parent_x, parent_max_y, parent_max_x;
-  int data_start, length, paint_x;
+  int data_start, length, paint_x, blocks;
   t3_bool result = t3_true;
   uint32_t block_size;
   size_t block_size_bytes;
+  int64_t composite_start = 0;
 
+  STATS_ADD(lines_composited, 1);
   _t3_terminal_window->paint_y = line;
   _t3_terminal_window->lines[line].width = 0;
   _t3_terminal_window->lines[line].length = 0;
   _t3_terminal_window->lines[line].start = 0;
 
+  if (_t3_win_stats_enabled && ensure_cell_owners()) {
+    memset(cell_owners + (size_t)line * cell_owners_width, 0,
+           cell_owners_width * sizeof(t3_window_t *));
+  }
+
   for (ptr = _t3_tail != NULL && !_t3_tail->shown ? get_previous_window(_t3_tail) : _t3_tail;
        ptr != NULL; ptr = get_previous_window(ptr)) {
     if (ptr->lines == NULL) {
@@ -1077,6 +1394,10 @@ t3_bool _t3_win_refresh_term_line(int line) {
       continue;
     }
 
+    if (_t3_win_stats_enabled) {
+      composite_start = _t3_monotonic_nsec();
+    }
+    painting_owner = ptr;
     data_start = 0;
     /* Draw/skip unused leading part of line. */
     if (x + draw->start >= parent_x) {
@@ -1118,8 +1439,8 @@ t3_bool _t3_win_refresh_term_line(int line) {
     }
 
     paint_x = _t3_terminal_window->paint_x;
-    for (length = data_start; length < draw->length;
-         length += (block_size >> 1) + block_size_bytes) {
+    for (length = data_start, blocks = 0; length < draw->length;
+         length += (block_size >> 1) + block_size_bytes, blocks++) {
       block_size = _t3_get_value(draw->data + length, &block_size_bytes);
       if (paint_x + _T3_BLOCK_SIZE_TO_WIDTH(block_size) > parent_max_x) {
         break;
@@ -1128,8 +1449,10 @@ t3_bool _t3_win_refresh_term_line(int line) {
     }
 
     if (length != data_start) {
+      int start = _t3_terminal_window->paint_x;
       result &=
           _win_write_blocks(_t3_terminal_window, draw->data + data_start, length - data_start);
+      set_cell_owners(start, _t3_terminal_window->paint_x);
     }
 
     /* Add a space for the multi-cell character that is crossed by the parent clipping. */
@@ -1144,7 +1467,14 @@ t3_bool _t3_win_refresh_term_line(int line) {
                                                     ? ptr->width - draw->start - draw->width
                                                     : parent_max_x - x - draw->start - draw->width);
     }
+
+    if (_t3_win_stats_enabled) {
+      ptr->frame_stats.lines_composited++;
+      ptr->frame_stats.blocks_copied += blocks;
+      ptr->frame_stats.composite_nsec += _t3_monotonic_nsec() - composite_start;
+    }
   }
+  painting_owner = NULL;
 
   /* If the default attributes for the terminal are not only a foreground color,
      we need to ensure that we paint the terminal. */
@@ -1170,6 +1500,7 @@ t3_bool _t3_win_refresh_term_line(int line) {
     }
   }
 
+  TRACE(TRACE_LINE_COMPOSITE, line, _t3_terminal_window->lines[line].width, 0);
   return result;
 }
 
@@ -0,0 +1,117 @@
+/* Compile with:
+   clang -o cap_test cap_test.c $(find ../src/.objects -name \*.o -path \*.libs\*) \
+     -I../src -I../../t3shared/include -ltranscript -lunistring -ltinfo -pthread
+
+   Run as:
+   ./cap_test [<terminal>...]
+
+   Checks that the pre-processed cursor movement strings produce the same output as tparm, for the
+   terminfo entries of the named terminals, or a list of common terminals if none are named. To
+   check all installed terminfo entries, use ./cap_test $(ls /usr/share/terminfo/?/)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capability.h"
+#include "curses_interface.h"
+#include "frame_buffer.h"
+
+static const struct {
+  const char *name;
+  int nr_of_args;
+} caps[] = {{"cup", 2}, {"hpa", 1}, {"vpa", 1}, {"cud", 1}, {"cuf", 1}};
+
+static const char *default_terminals[] = {"xterm",   "xterm-256color", "screen", "tmux",
+                                          "linux",   "vt100",          "vt220",  "rxvt",
+                                          "konsole", "putty",          "ansi",   "cygwin"};
+
+static const int args[] = {0, 1, 8, 9, 10, 99, 100, 254, 255, 999, 1000, 32767};
+
+static int failures, strings_checked, strings_compiled;
+
+/* Return the contents of the frame buffer as a newly allocated string, and clear it. */
+static char *take_frame(void) {
+  size_t length = _t3_frame_length();
+  char *result = malloc(length + 1);
+
+  if (result == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(result, _t3_frame_get(0), length);
+  result[length] = 0;
+  _t3_frame_truncate(0);
+  return result;
+}
+
+static void check_cap(const char *terminal, const char *name, int nr_of_args) {
+  compiled_cap_t compiled;
+  char *cap, *expected, *output;
+  size_t i, j;
+
+  cap = _t3_tigetstr(name);
+  if (cap == NULL || cap == (char *)-1) {
+    return;
+  }
+
+  _t3_compile_cap(&compiled, cap, nr_of_args);
+  strings_checked++;
+  if (compiled.simple) {
+    strings_compiled++;
+  }
+
+  for (i = 0; i < sizeof(args) / sizeof(args[0]); i++) {
+    for (j = 0; j < sizeof(args) / sizeof(args[0]); j++) {
+      _t3_putp(_t3_tparm(cap, 2, args[i], args[j]));
+      expected = take_frame();
+      _t3_putp_cap(&compiled, args[i], args[j]);
+      output = take_frame();
+      if (strcmp(expected, output) != 0) {
+        printf("%s: %s(%d, %d) differs from tparm (%s)\n", terminal, name, args[i], args[j],
+               compiled.simple ? "pre-processed" : "not pre-processed");
+        failures++;
+      }
+      free(expected);
+      free(output);
+      if (nr_of_args == 1) {
+        break;
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char **terminals = default_terminals;
+  int nr_of_terminals = sizeof(default_terminals) / sizeof(default_terminals[0]);
+  int i, terminals_found = 0;
+  size_t j;
+
+  if (argc > 1) {
+    terminals = (const char **)argv + 1;
+    nr_of_terminals = argc - 1;
+  }
+
+  for (i = 0; i < nr_of_terminals; i++) {
+    if (_t3_setupterm(terminals[i], 1) != 0) {
+      continue;
+    }
+    terminals_found++;
+    for (j = 0; j < sizeof(caps) / sizeof(caps[0]); j++) {
+      check_cap(terminals[i], caps[j].name, caps[j].nr_of_args);
+    }
+  }
+
+  if (terminals_found == 0) {
+    printf("None of the terminals was found in the terminfo database\n");
+    return EXIT_FAILURE;
+  }
+  printf("%d strings checked for %d terminals, %d of which were pre-processed\n", strings_checked,
+         terminals_found, strings_compiled);
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
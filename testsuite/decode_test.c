@@ -0,0 +1,109 @@
+/* Compile with:
+   clang -o decode_test decode_test.c -I../src -I../../t3shared/include \
+     -L../src/.libs -lt3window -Wl,-rpath=$PWD/../src/.libs
+
+   Checks that t3_utf8_decode gives the same result as calling t3_utf8_get repeatedly, for valid
+   and invalid UTF-8, and for all output buffer sizes.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utf8.h"
+
+static int failures;
+
+/* Decode str in pieces of at most dst_size codepoints, and compare each piece to the result of
+   t3_utf8_get. */
+static void check_decode(const char *str, size_t n, size_t dst_size, const char *description) {
+  uint32_t dst[512];
+  size_t idx = 0, expected_idx, decoded, size, codepoint_len, i;
+
+  while (idx < n) {
+    size = n - idx;
+    decoded = t3_utf8_decode(str + idx, &size, dst, dst_size);
+    if (decoded == 0 || decoded > dst_size || size == 0 || size > n - idx) {
+      printf("%s: invalid result (%zu codepoints, %zu bytes) at offset %zu\n", description, decoded,
+             size, idx);
+      failures++;
+      return;
+    }
+    for (i = 0, expected_idx = idx; i < decoded; i++) {
+      codepoint_len = n - expected_idx;
+      if (dst[i] != t3_utf8_get(str + expected_idx, &codepoint_len)) {
+        printf("%s: codepoint %04X differs at offset %zu\n", description, dst[i], expected_idx);
+        failures++;
+        return;
+      }
+      expected_idx += codepoint_len;
+    }
+    if (expected_idx != idx + size) {
+      printf("%s: %zu bytes decoded at offset %zu, expected %zu\n", description, size, idx,
+             expected_idx - idx);
+      failures++;
+      return;
+    }
+    idx += size;
+  }
+}
+
+static void check_all_sizes(const char *str, size_t n, const char *description) {
+  size_t dst_size;
+
+  for (dst_size = 1; dst_size <= n + 1 && dst_size <= 512; dst_size++) {
+    check_decode(str, n, dst_size, description);
+  }
+}
+
+int main() {
+  static const char *sequences[] = {
+      "plain ASCII",
+      "caf\xc3\xa9 \xe4\xb8\xad\xe6\x96\x87 \xf0\x9f\x98\x80",
+      /* Overlong encodings. */
+      "\xc0\xaf\xc1\xbf\xe0\x80\xaf\xf0\x80\x80\xaf",
+      /* Surrogates and codepoints above U+10FFFF. */
+      "\xed\xa0\x80\xed\xbf\xbf\xf4\x90\x80\x80\xf7\xbf\xbf\xbf",
+      /* Truncated sequences, stray continuation bytes and invalid lead bytes. */
+      "\xc3 \xe4\xb8 \xf0\x9f\x98 \x80\xbf\xfe\xff",
+      /* Largest codepoint, and the first and last codepoints of each length. */
+      "\xf4\x8f\xbf\xbf\x7f\xc2\x80\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf\xf0\x90\x80\x80",
+  };
+  char buffer[1024];
+  size_t i, j, n, pos;
+
+  for (i = 0; i < sizeof(sequences) / sizeof(sequences[0]); i++) {
+    check_all_sizes(sequences[i], strlen(sequences[i]), sequences[i]);
+    /* Check that a sequence split at the end of the input is handled correctly. */
+    for (n = 1; n < strlen(sequences[i]); n++) {
+      check_decode(sequences[i], n, 512, "truncated sequence");
+    }
+  }
+
+  /* Long ASCII runs are decoded by the vector code, so put a non-ASCII character at every position
+     in such a run to check the transitions. */
+  for (pos = 0; pos < 200; pos++) {
+    memset(buffer, 'x', 200);
+    memcpy(buffer + pos, "\xce\xbb", 2);
+    check_all_sizes(buffer, 202, "ASCII run");
+    buffer[pos] = (char)0x80;
+    check_all_sizes(buffer, 200, "ASCII run with invalid byte");
+  }
+
+  srand(1);
+  for (i = 0; i < 20000; i++) {
+    n = rand() % sizeof(buffer);
+    for (j = 0; j < n; j++) {
+      /* Mostly ASCII, to get runs that are long enough for the vector code. */
+      buffer[j] = rand() % 10 < 7 ? rand() % 128 : rand() % 256;
+    }
+    check_decode(buffer, n, 1 + rand() % 512, "random bytes");
+  }
+
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/* Compile with:
+   clang -o gb18030_test gb18030_test.c $(find ../src/.objects -name \*.o -path \*.libs\*) \
+     -I../src -I../../t3shared/include -ltranscript -lunistring -ltinfo -pthread
+
+   Checks the built-in GB18030 encoder against the GB18030 converter of libtranscript, which was
+   used for GB18030 terminals before, for all codepoints.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <transcript/transcript.h>
+
+#include "convert_output.h"
+#include "utf8.h"
+
+int main() {
+  transcript_t *converter;
+  char input[4], expected[16], encoded[4];
+  const char *input_ptr;
+  char *expected_ptr;
+  size_t input_len, encoded_len, expected_len;
+  int failures = 0, result;
+  uint32_t c;
+
+  transcript_init();
+  if ((converter = transcript_open_converter("GB18030", TRANSCRIPT_UTF8, 0, NULL)) == NULL) {
+    printf("Could not open the GB18030 converter of libtranscript\n");
+    return EXIT_FAILURE;
+  }
+
+  for (c = 0; c < 0x110000; c++) {
+    encoded_len = _t3_gb18030_put(c, encoded);
+    if (c >= 0xd800 && c <= 0xdfff) {
+      if (encoded_len != 0) {
+        printf("Surrogate U+%04X was encoded\n", c);
+        failures++;
+      }
+      continue;
+    }
+
+    input_len = t3_utf8_put(c, input);
+    input_ptr = input;
+    expected_ptr = expected;
+    result = transcript_from_unicode(converter, &input_ptr, input + input_len, &expected_ptr,
+                                     expected + sizeof(expected), TRANSCRIPT_END_OF_TEXT);
+    if (result == TRANSCRIPT_SUCCESS) {
+      result = transcript_from_unicode_flush(converter, &expected_ptr, expected + sizeof(expected));
+    }
+    transcript_from_unicode_reset(converter);
+    if (result != TRANSCRIPT_SUCCESS) {
+      if (encoded_len != 0) {
+        printf("U+%04X was encoded, but libtranscript can not convert it\n", c);
+        failures++;
+      }
+      continue;
+    }
+
+    expected_len = expected_ptr - expected;
+    if (encoded_len != expected_len || memcmp(encoded, expected, expected_len) != 0) {
+      printf("U+%04X is encoded differently than by libtranscript\n", c);
+      failures++;
+    }
+  }
+
+  if (_t3_gb18030_put(0x110000, encoded) != 0) {
+    printf("Codepoint above U+10FFFF was encoded\n");
+    failures++;
+  }
+
+  transcript_close_converter(converter);
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
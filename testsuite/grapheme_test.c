@@ -0,0 +1,139 @@
+/* Compile with:
+   clang -o grapheme_test grapheme_test.c -I../src -I../../t3shared/include \
+     -L../src/.libs -lt3window -Wl,-rpath=$PWD/../src/.libs
+
+   Checks the grapheme cluster boundaries found by t3_utf8_grapheme_length. The expected clusters
+   follow Unicode Standard Annex #29 for Unicode 16.0.0. The rule for Indic conjuncts (GB9c) is not
+   implemented, so it is not tested.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utf8.h"
+
+#define MAX_CLUSTERS 4
+
+typedef struct {
+  const char *rule;
+  const char *clusters[MAX_CLUSTERS];
+} test_case_t;
+
+/* Universal character names are used for all non-ASCII characters, which are encoded in UTF-8. */
+static const test_case_t test_cases[] = {
+    {"GB3", {"\r\n"}},
+    {"GB4", {"\r", "a"}},
+    {"GB5", {"a", "\n"}},
+    {"GB4/GB5", {"a", "\x01", "b"}},
+    {"GB6", {"\u1100\u1100\u1161\u11a8"}},
+    {"GB6", {"\u1100\uac00"}},
+    {"GB7", {"\uac00\u1161"}},
+    {"GB8", {"\uac00\u11a8"}},
+    {"GB8", {"\uac01\u11a8"}},
+    {"GB999", {"\u11a8", "\u1100"}},
+    {"GB999", {"\u1161", "\u1100"}},
+    {"GB999", {"\uac01", "\uac00"}},
+    {"GB9", {"e\u0301\u0302"}},
+    {"GB9", {"a\u200d"}},
+    {"GB9", {" \u0308", "A"}},
+    {"GB9a", {"\u0915\u093f"}},
+    {"GB9a", {"\u0e01\u0e33"}},
+    {"GB9b", {"\u0600" "1"}},
+    {"GB5", {"\u0600", "\n"}},
+    {"GB11", {"\U0001f468\u200d\U0001f469\u200d\U0001f467"}},
+    {"GB11", {"\U0001f600\u0301\u200d\u2764"}},
+    {"GB9", {"\U0001f44d\U0001f3fd"}},
+    {"GB999", {"a\u200d", "\U0001f600"}},
+    {"GB12", {"\U0001f1f3\U0001f1f1", "\U0001f1e7\U0001f1ea"}},
+    {"GB12", {"\U0001f1f3\U0001f1f1", "\U0001f1e7"}},
+    {"GB13", {"a", "\U0001f1f3\U0001f1f1"}},
+    {"GB999", {"\U0001f1e6\u200d", "\U0001f1e7"}},
+    {"GB999", {"a", "b"}},
+};
+
+static int failures;
+
+static void check_test_case(const test_case_t *test_case) {
+  char buffer[256];
+  size_t n = 0, idx = 0, length;
+  int i;
+
+  for (i = 0; i < MAX_CLUSTERS && test_case->clusters[i] != NULL; i++) {
+    strcpy(buffer + n, test_case->clusters[i]);
+    n += strlen(test_case->clusters[i]);
+  }
+
+  for (i = 0; i < MAX_CLUSTERS && test_case->clusters[i] != NULL; i++) {
+    length = t3_utf8_grapheme_length(buffer + idx, n - idx);
+    if (length != strlen(test_case->clusters[i])) {
+      printf("%s: cluster %d of test case starting with U+%04X has length %zu, expected %zu\n",
+             test_case->rule, i, t3_utf8_get(buffer, NULL), length,
+             strlen(test_case->clusters[i]));
+      failures++;
+      return;
+    }
+    idx += length;
+  }
+}
+
+/* Check that splitting a string into clusters consumes all of it, and never splits a UTF-8
+   sequence. */
+static void check_split(const char *str, size_t n) {
+  size_t idx = 0, length, codepoint_idx, codepoint_len;
+
+  while (idx < n) {
+    length = t3_utf8_grapheme_length(str + idx, n - idx);
+    if (length == 0 || length > n - idx) {
+      printf("Invalid cluster length %zu at offset %zu of %zu\n", length, idx, n);
+      failures++;
+      return;
+    }
+    for (codepoint_idx = idx; codepoint_idx < idx + length; codepoint_idx += codepoint_len) {
+      codepoint_len = n - codepoint_idx;
+      t3_utf8_get(str + codepoint_idx, &codepoint_len);
+    }
+    if (codepoint_idx != idx + length) {
+      printf("Cluster at offset %zu ends inside a UTF-8 sequence\n", idx);
+      failures++;
+      return;
+    }
+    idx += length;
+  }
+}
+
+int main() {
+  static const uint32_t pool[] = {'a',    '\r',    '\n',    0x01,    0x301,   0x200d,  0x600,
+                                  0x915,  0x93f,   0x1100,  0x1161,  0x11a8,  0xac00,  0xac01,
+                                  0xfe0f, 0x1f468, 0x1f3fd, 0x1f1f3, 0x1f1f1, 0x10ffff};
+  char buffer[1024];
+  size_t i, j, n;
+
+  for (i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+    check_test_case(&test_cases[i]);
+  }
+
+  if (t3_utf8_grapheme_length("a", 0) != 0) {
+    printf("Empty string has a non-empty cluster\n");
+    failures++;
+  }
+
+  srand(3);
+  for (i = 0; i < 20000; i++) {
+    for (j = 0, n = 0; j < 100; j++) {
+      if (rand() % 10 == 0) {
+        buffer[n++] = rand() % 256;
+      } else {
+        n += t3_utf8_put(pool[rand() % (sizeof(pool) / sizeof(pool[0]))], buffer + n);
+      }
+    }
+    check_split(buffer, n);
+  }
+
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+/* Compile with:
+   clang -o output_buffer_test output_buffer_test.c \
+     $(find ../src/.objects -name \*.o -path \*.libs\*) \
+     -I../src -I../../t3shared/include -ltranscript -lunistring -ltinfo -pthread
+
+   Checks that text added to the output buffer with t3_term_reserve and t3_term_commit, mixed with
+   the other output functions, reaches the frame buffer unchanged, and that the output is
+   normalized to NFC.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert_output.h"
+#include "frame_buffer.h"
+#include "internal.h"
+
+#define LARGE_SIZE 100000
+
+static int failures;
+
+/* Print the output buffer and compare the frame buffer with @p expected. */
+static void check_output(const char *expected, size_t expected_length, const char *description) {
+  _t3_output_buffer_print();
+  if (_t3_frame_length() != expected_length ||
+      memcmp(_t3_frame_get(0), expected, expected_length) != 0) {
+    printf("%s: output differs (%zu bytes, expected %zu)\n", description, _t3_frame_length(),
+           expected_length);
+    failures++;
+  }
+  _t3_frame_truncate(0);
+}
+
+int main() {
+  char *reserved, *expected;
+
+  if (!_t3_init_output_buffer() || !_t3_init_output_converter("UTF-8")) {
+    printf("Could not initialize the output buffer\n");
+    return EXIT_FAILURE;
+  }
+  /* Pretend the terminal supports all combining and double width characters, so nothing is
+     filtered. */
+  _t3_term_combining = 255;
+  _t3_term_double_width = 255;
+
+  reserved = t3_term_reserve(5);
+  memcpy(reserved, "hello", 5);
+  t3_term_commit(5);
+  t3_term_puts(", ");
+  /* Only part of the reserved space is used. */
+  reserved = t3_term_reserve(10);
+  memcpy(reserved, "wo", 2);
+  t3_term_commit(2);
+  t3_term_putn("rld", 3);
+  t3_term_putc('!');
+  check_output("hello, world!", 13, "small reservations");
+
+  /* A reservation larger than the output buffer must keep the text before it. */
+  if ((expected = malloc(LARGE_SIZE + 3)) == NULL) {
+    printf("Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  memcpy(expected, "abc", 3);
+  memset(expected + 3, 'x', LARGE_SIZE);
+  t3_term_puts("abc");
+  if ((reserved = t3_term_reserve(LARGE_SIZE)) == NULL) {
+    printf("Could not reserve %d bytes\n", LARGE_SIZE);
+    return EXIT_FAILURE;
+  }
+  memset(reserved, 'x', LARGE_SIZE);
+  t3_term_commit(LARGE_SIZE);
+  check_output(expected, LARGE_SIZE + 3, "large reservation");
+  free(expected);
+
+  /* The output buffer is normalized to NFC before it is printed. */
+  t3_term_puts("cafe\xcc\x81 \xe2\x84\xab");
+  check_output("caf\xc3\xa9 \xc3\x85", 8, "normalization");
+
+  _t3_free_output_buffer();
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
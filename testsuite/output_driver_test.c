@@ -0,0 +1,141 @@
+/* Compile with:
+   clang -o output_driver_test output_driver_test.c \
+     $(find ../src/.objects -name \*.o -path \*.libs\*) \
+     -I../src -I../../t3shared/include -ltranscript -lunistring -ltinfo -pthread
+
+   Checks that the xterm output driver produces exactly the same output as the terminfo driver for
+   the xterm terminfo entry, for cursor movements and for all transitions between a set of
+   attributes. A pseudo terminal is used as the terminal, so no terminal is required to run it.
+*/
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "frame_buffer.h"
+#include "internal.h"
+#include "output_driver.h"
+
+#define NR_OF_COLORS (sizeof(colors) / sizeof(colors[0]))
+
+/* Color values as stored in the attributes: unspecified, default, and one color from each of the
+   ranges that are set using different sequences. */
+static const t3_attr_t colors[] = {0, 257, 1, 10, 17, 256};
+
+static int failures;
+
+/* Return the output generated since @p start as a newly allocated string, and remove it. */
+static char *take_output(size_t start) {
+  size_t length = _t3_frame_length() - start;
+  char *result = malloc(length + 1);
+
+  if (result == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(result, _t3_frame_get(start), length);
+  result[length] = 0;
+  _t3_frame_truncate(start);
+  return result;
+}
+
+/* Compare the output of both drivers, and print a description of the operation if they differ. */
+static void compare(char *expected, char *output, const char *description, long arg1, long arg2) {
+  if (strcmp(expected, output) != 0) {
+    printf("%s(%lx, %lx) differs from the terminfo driver\n", description, arg1, arg2);
+    failures++;
+  }
+  free(expected);
+  free(output);
+}
+
+static void check_set_attrs(t3_attr_t old_attrs, t3_attr_t new_attrs, size_t start) {
+  t3_attr_t expected_attrs;
+  char *expected;
+
+  _t3_attrs = old_attrs;
+  _t3_terminfo_driver.set_attrs(new_attrs);
+  expected_attrs = _t3_attrs;
+  expected = take_output(start);
+
+  _t3_attrs = old_attrs;
+  _t3_xterm_driver.set_attrs(new_attrs);
+  if (_t3_attrs != expected_attrs) {
+    printf("set_attrs(%lx, %lx) results in different attributes\n", (long)old_attrs,
+           (long)new_attrs);
+    failures++;
+  }
+  compare(expected, take_output(start), "set_attrs", (long)old_attrs, (long)new_attrs);
+}
+
+int main() {
+  struct winsize size = {24, 80, 0, 0};
+  t3_attr_t *attrs;
+  size_t nr_of_attrs = 0, start, i, j, k;
+  int master, slave, line, col;
+  char *expected;
+
+  unsetenv("T3WINDOW_OPTS");
+  if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) != 0 ||
+      unlockpt(master) != 0 || (slave = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0) {
+    printf("Could not open a pseudo terminal\n");
+    return EXIT_FAILURE;
+  }
+  if (ioctl(master, TIOCSWINSZ, &size) != 0 || t3_term_init(slave, "xterm") != T3_ERR_SUCCESS) {
+    printf("Could not initialize the terminal\n");
+    return EXIT_FAILURE;
+  }
+  if (_t3_output_driver != &_t3_xterm_driver) {
+    printf("The xterm driver is not selected for xterm\n");
+    return EXIT_FAILURE;
+  }
+  start = _t3_frame_length();
+
+  for (line = 0; line < 1000; line += line < 20 ? 1 : 97) {
+    for (col = 0; col < 1000; col += col < 20 ? 1 : 89) {
+      _t3_terminfo_driver.cup(line, col);
+      expected = take_output(start);
+      _t3_xterm_driver.cup(line, col);
+      compare(expected, take_output(start), "cup", line, col);
+    }
+    _t3_terminfo_driver.hpa(line);
+    expected = take_output(start);
+    _t3_xterm_driver.hpa(line);
+    compare(expected, take_output(start), "hpa", line, 0);
+  }
+
+  /* All combinations of the basic attributes, with all combinations of the selected colors. */
+  if ((attrs = malloc(64 * NR_OF_COLORS * NR_OF_COLORS * sizeof(t3_attr_t))) == NULL) {
+    printf("Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < 64; i++) {
+    for (j = 0; j < NR_OF_COLORS; j++) {
+      for (k = 0; k < NR_OF_COLORS; k++) {
+        attrs[nr_of_attrs++] = (i << 1) | (colors[j] << T3_ATTR_COLOR_SHIFT) |
+                               (colors[k] << (T3_ATTR_COLOR_SHIFT + 9));
+      }
+    }
+  }
+
+  for (i = 0; i < nr_of_attrs; i++) {
+    for (j = 0; j < nr_of_attrs; j++) {
+      check_set_attrs(attrs[i], attrs[j], start);
+    }
+  }
+  free(attrs);
+
+  _t3_attrs = 0;
+  t3_term_deinit();
+  close(slave);
+  close(master);
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+/* Compile with:
+   clang -o strncwidth_test strncwidth_test.c -I../src -I../../t3shared/include \
+     -L../src/.libs -lt3window -Wl,-rpath=$PWD/../src/.libs
+
+   Checks t3_term_strncwidth and t3_term_strncwidth_prefix against a straightforward
+   implementation using t3_utf8_get and t3_utf8_wcwidth_ext.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "terminal.h"
+#include "utf8.h"
+
+static int failures;
+
+static size_t reference_width(const char *str, size_t n) {
+  size_t width = 0, codepoint_len;
+  int codepoint_width, state = 0;
+
+  for (; n > 0; n -= codepoint_len, str += codepoint_len) {
+    codepoint_len = n;
+    codepoint_width = t3_utf8_wcwidth_ext(t3_utf8_get(str, &codepoint_len), &state);
+    if (codepoint_width > 0) {
+      width += codepoint_width;
+    }
+  }
+  return width;
+}
+
+static size_t reference_prefix(const char *str, size_t n, size_t max_width, size_t *width) {
+  size_t idx = 0, codepoint_len;
+  int codepoint_width, state = 0;
+
+  *width = 0;
+  while (idx < n) {
+    codepoint_len = n - idx;
+    codepoint_width = t3_utf8_wcwidth_ext(t3_utf8_get(str + idx, &codepoint_len), &state);
+    if (codepoint_width > 0) {
+      if ((size_t)codepoint_width > max_width - *width) {
+        break;
+      }
+      *width += codepoint_width;
+    }
+    idx += codepoint_len;
+  }
+  return idx;
+}
+
+static void check_string(const char *str, size_t n, size_t max_width) {
+  size_t width, expected_width, prefix, expected_prefix;
+
+  if ((width = t3_term_strncwidth(str, n)) != (expected_width = reference_width(str, n))) {
+    printf("t3_term_strncwidth: width %zu, expected %zu\n", width, expected_width);
+    failures++;
+  }
+
+  prefix = t3_term_strncwidth_prefix(str, n, max_width, &width);
+  expected_prefix = reference_prefix(str, n, max_width, &expected_width);
+  if (prefix != expected_prefix || width != expected_width) {
+    printf("t3_term_strncwidth_prefix(%zu): prefix %zu width %zu, expected prefix %zu width %zu\n",
+           max_width, prefix, width, expected_prefix, expected_width);
+    failures++;
+  }
+}
+
+int main() {
+  /* Characters of all widths, combining characters, Hangul Jamo (which are handled by
+     t3_utf8_wcwidth_ext), control characters and the largest codepoint. */
+  static const uint32_t pool[] = {'a',    ' ',    '\t',    0x7f,   0xe9,   0x301,  0x416,
+                                  0x3042, 0x3099, 0x4e2d,  0xac00, 0xac01, 0x1100, 0x1161,
+                                  0x11a8, 0xfe0f, 0x1f600, 0x200b, 0xff21, 0x10ffff};
+  char buffer[2048];
+  size_t i, n, length, max_width;
+  uint32_t c;
+  int mode;
+
+  /* Check every codepoint, repeated such that runs of equal width characters are handled. */
+  for (c = 0; c < 0x110000; c++) {
+    for (i = 0, n = 0; i < 4; i++) {
+      n += t3_utf8_put(c, buffer + n);
+    }
+    check_string(buffer, n, 3);
+  }
+
+  srand(2);
+  for (i = 0; i < 50000; i++) {
+    length = rand() % 300;
+    mode = rand() % 3;
+    for (n = 0; n < length;) {
+      int r = rand() % 10;
+      if (mode == 0 && r < 8) {
+        buffer[n++] = 'a' + rand() % 26;
+      } else if (mode == 1 && r < 8) {
+        n += t3_utf8_put(0x4e00 + rand() % 0x5200, buffer + n);
+      } else if (r < 9) {
+        n += t3_utf8_put(pool[rand() % (sizeof(pool) / sizeof(pool[0]))], buffer + n);
+      } else {
+        buffer[n++] = rand() % 256;
+      }
+    }
+    max_width = rand() % (reference_width(buffer, n) + 2);
+    check_string(buffer, n, max_width);
+    check_string(buffer, n, SIZE_MAX);
+  }
+
+  if (failures != 0) {
+    printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}